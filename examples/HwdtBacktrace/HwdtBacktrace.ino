@@ -7,7 +7,8 @@
    an indicator for debug support; however, the selected serial port is not used
    by the tools. It will print to port Serial.
 
-   Add `HwdLastCall.cpp` to the Sketch folder and build.
+   Build with `-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT=1` and the "-finstrument-functions"
+   options from `HwdtBacktrace.ino.globals.h`.
 
    When the ESP8266 restarts because of a Hardware WDT reset, the serial port
    speed defaults to 115200 bps. The HWDT stack dump will always print on port
@@ -13,6 +13,13 @@
 // -DDEBUG_ESP_BACKTRACE_CPP=1
 -DDEBUG_ESP_HWDT_POST_REPORT_CB=hwdt_post_processing
 
+// BacktraceLog provides __cyg_profile_func_enter/exit and the HWDT report
+-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT=1
+
+// Function enter/exit events, with CCOUNT, kept for the HWDT report timeline.
+// Must be a power of 2, 0 disables.
+// -DDEBUG_ESP_BACKTRACELOG_EVENT_RING=64
+
 
 // For this block to work, you must have
 // `mkbuildoptglobals.extra_flags={build.debug_port}` in `platform.local.txt`
@@ -0,0 +1,58 @@
+/*
+  Measure the cost of the "-finstrument-functions" hooks provided by
+  BacktraceLog.
+
+  Times 1000 calls to a small function built with and without instrumentation.
+  The difference is the cost of one __cyg_profile_func_enter/exit pair. Build
+  once with -DDEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST=0 and once with =1, see
+  InstrumentBenchmark.ino.globals.h, and compare.
+
+  The best of several runs is reported, this removes most of the interrupt
+  noise.
+*/
+#include <BacktraceInstrument.h>
+
+constexpr uint32_t kCalls = 1000;
+constexpr int kRuns = 8;
+
+volatile int sink;
+
+int __attribute__((noinline)) instrumented(int a) {
+  return a + 1;
+}
+
+int __attribute__((noinline, no_instrument_function)) plain(int a) {
+  return a + 1;
+}
+
+uint32_t __attribute__((no_instrument_function)) time_calls(int (*fn)(int)) {
+  uint32_t best = UINT32_MAX;
+  for (int run = 0; run < kRuns; run++) {
+    int a = 0;
+    uint32_t start = ESP.getCycleCount();
+    for (uint32_t i = 0; i < kCalls; i++) {
+      a = fn(a);
+    }
+    uint32_t elapsed = ESP.getCycleCount() - start;
+    sink = a;
+    if (elapsed < best) best = elapsed;
+  }
+  return best;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(200);
+
+  Serial.printf_P(PSTR("\r\n\r\n\r\nDemo: instrument-functions hook overhead\r\n\r\n"));
+  Serial.printf_P(PSTR("DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST=%d, DEBUG_ESP_BACKTRACELOG_EVENT_RING=%d\r\n"),
+      DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST, DEBUG_ESP_BACKTRACELOG_EVENT_RING);
+}
+
+void loop() {
+  uint32_t with = time_calls(instrumented);
+  uint32_t without = time_calls(plain);
+  Serial.printf_P(PSTR("%u calls: instrumented %u cycles, plain %u cycles, enter/exit pair %u cycles\r\n"),
+      kCalls, with, without, (with - without) / kCalls);
+  delay(5000);
+}
@@ -0,0 +1,47 @@
+/*@create-file:build.opt@
+// See library BacktraceLog ReadMe.md for details
+
+-finstrument-functions
+-finstrument-functions-exclude-function-list=app_entry,ets_intr_,ets_post,Cache_Read_Enable,non32xfer_exception_handler
+-finstrument-functions-exclude-file-list=umm_malloc,hwdt_app_entry,core_esp8266_postmortem,core_esp8266_app_entry_noextra4k,mmu_iram,backtrace,BacktraceLog,StackThunk
+
+// BacktraceLog provides __cyg_profile_func_enter/exit
+-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT=1
+
+// Compare the C hooks (0) with the asm hooks (1)
+-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST=1
+
+// Function enter/exit events kept in a ring buffer, 0 disables
+// -DDEBUG_ESP_BACKTRACELOG_EVENT_RING=64
+*/
+
+/*@create-file:build.opt:debug@
+
+-finstrument-functions
+-finstrument-functions-exclude-function-list=app_entry,ets_intr_,ets_post,Cache_Read_Enable,non32xfer_exception_handler
+-finstrument-functions-exclude-file-list=umm_malloc,hwdt_app_entry,core_esp8266_postmortem,core_esp8266_app_entry_noextra4k,mmu_iram,backtrace,BacktraceLog,StackThunk
+
+// BacktraceLog provides __cyg_profile_func_enter/exit
+-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT=1
+
+// Compare the C hooks (0) with the asm hooks (1)
+-DDEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST=1
+
+// Function enter/exit events kept in a ring buffer, 0 disables
+// -DDEBUG_ESP_BACKTRACELOG_EVENT_RING=64
+*/
+
+
+#ifndef INSTRUMENTBENCHMARK_INO_GLOBALS_H
+#define INSTRUMENTBENCHMARK_INO_GLOBALS_H
+#if defined(__cplusplus)
+// Defines kept private to .cpp modules
+//#pragma message("__cplusplus has been seen")
+#endif
+#if !defined(__cplusplus) && !defined(__ASSEMBLER__)
+// Defines kept private to .c modules
+#endif
+#if defined(__ASSEMBLER__)
+// Defines kept private to assembler modules
+#endif
+#endif
@@ -0,0 +1,71 @@
+/*
+  Check the interrupts-disabled latency tracer against known sections.
+
+  Each pass disables interrupts with noInterrupts(), waits with
+  delayMicroseconds(), and enables them again with interrupts(). The longest
+  section saved in the log should be about that long, in CPU cycles. Then the
+  same with xt_rsil(15) and xt_wsr_ps().
+
+  The tracer only sees code that includes BacktraceIrqTrace.h; this example's
+  .ino.globals.h includes it for the whole build.
+*/
+#include <user_interface.h>
+#include <BacktraceLog.h>
+BacktraceLog backtraceLog;
+
+struct BACKTRACE_LOG logCopy;
+
+// Allowed error, the tracer's own overhead and delayMicroseconds() rounding.
+constexpr uint32_t slack_cycles = 400;
+
+bool check(const char *what, uint32_t us) {
+  uint32_t expect = us * ESP.getCpuFreqMHz();
+  backtraceLog_irq_trace_commit();
+  backtraceLog.read(&logCopy);
+  uint32_t cycles = logCopy.irqOff[0].cycles;
+  bool pass = cycles + slack_cycles >= expect && cycles <= expect + slack_cycles;
+  Serial.printf("%s %5u us: expect %7u cycles, longest %7u, %s\r\n",
+    what, us, expect, cycles, (pass) ? "PASS" : "FAIL");
+  return pass;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(200);
+  Serial.printf("\r\n\r\n\r\nDemo: interrupts-disabled latency tracer\r\n\r\n");
+
+  bool pass = true;
+  for (uint32_t us : {50u, 200u, 1000u}) {
+    backtraceLog.clear();
+    noInterrupts();
+    delayMicroseconds(us);
+    interrupts();
+    pass &= check("noInterrupts()/interrupts()", us);
+
+    backtraceLog.clear();
+    uint32_t saved_ps = xt_rsil(15);
+    delayMicroseconds(us);
+    xt_wsr_ps(saved_ps);
+    pass &= check("xt_rsil(15)/xt_wsr_ps()    ", us);
+  }
+
+  // interrupts() closes the section. The 10ms with interrupts enabled must
+  // not show up at the next xt_wsr_ps() to level 0.
+  backtraceLog.clear();
+  noInterrupts();
+  interrupts();
+  delay(10);
+  xt_wsr_ps(0);
+  backtraceLog_irq_trace_commit();
+  backtraceLog.read(&logCopy);
+  bool idle = logCopy.irqOff[0].cycles < slack_cycles;
+  Serial.printf("Enabled time not counted: longest %u cycles, %s\r\n",
+    logCopy.irqOff[0].cycles, (idle) ? "PASS" : "FAIL");
+  pass &= idle;
+
+  Serial.printf("\r\n%s\r\n\r\n", (pass) ? "All passed" : "FAILED");
+  backtraceLog.report(Serial);
+}
+
+void loop() {
+}
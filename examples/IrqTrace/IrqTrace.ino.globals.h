@@ -0,0 +1,47 @@
+/*@create-file:build.opt@
+// See library BacktraceLog ReadMe.md for details
+
+-fno-optimize-sibling-calls
+
+// Maximum backtrace addresses to save
+-DDEBUG_ESP_BACKTRACELOG_MAX=32
+
+// Run the backtrace from IRAM, needed with interrupts off
+-DBACKTRACE_IN_IRAM=1
+
+// Keep the 4 longest interrupts-disabled sections
+-DDEBUG_ESP_BACKTRACELOG_IRQ_TRACE=4
+*/
+
+/*@create-file:build.opt:debug@
+
+-fno-optimize-sibling-calls
+
+// Maximum backtrace addresses to save
+-DDEBUG_ESP_BACKTRACELOG_MAX=32
+
+// Run the backtrace from IRAM, needed with interrupts off
+-DBACKTRACE_IN_IRAM=1
+
+// Keep the 4 longest interrupts-disabled sections
+-DDEBUG_ESP_BACKTRACELOG_IRQ_TRACE=4
+*/
+
+
+#ifndef IRQTRACE_INO_GLOBALS_H
+#define IRQTRACE_INO_GLOBALS_H
+#if !defined(__ASSEMBLER__) && __has_include(<BacktraceIrqTrace.h>)
+// Time xt_rsil()/xt_wsr_ps() sections in everything built with the sketch
+#include <BacktraceIrqTrace.h>
+#endif
+#if defined(__cplusplus)
+// Defines kept private to .cpp modules
+//#pragma message("__cplusplus has been seen")
+#endif
+#if !defined(__cplusplus) && !defined(__ASSEMBLER__)
+// Defines kept private to .c modules
+#endif
+#if defined(__ASSEMBLER__)
+// Defines kept private to assembler modules
+#endif
+#endif
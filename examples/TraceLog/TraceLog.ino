@@ -0,0 +1,86 @@
+/*
+  Two BacktraceLogT logs beside the crash log.
+
+  traceLog holds the last 64 PCs in noinit DRAM; each pass through loop()
+  records a short backtrace from a few levels down. bootLog keeps the first 8
+  boots in user RTC memory from word 160, which survives deep sleep and
+  EXT_RST as well.
+
+  Hotkeys:
+    t   report traceLog
+    b   report bootLog
+    c   clear both
+    r   ESP.restart(), the logs are kept
+    z   divide by zero, the crash log reports it after the restart
+*/
+#include <Arduino.h>
+#include <BacktraceLog.h>
+#include <BacktraceLogT.h>
+BacktraceLog backtraceLog;
+
+BacktraceLogT<64, BacktraceStorageDram, BacktraceRecordRing> traceLog;
+BacktraceLogT<8, BacktraceStorageRtc<160>, BacktraceRecordFirst> bootLog;
+
+#define STATIC __attribute__((noinline))
+
+STATIC int level3(int a, int b) {
+  traceLog.record(4);
+  return a / b;
+}
+
+STATIC int level2(int a, int b) {
+  return level3(a, b) + 1;
+}
+
+STATIC int level1(int a, int b) {
+  return level2(a, b) + 1;
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  delay(200);
+  Serial.printf_P(PSTR("\r\n\r\nBacktraceLogT Demo ...\r\n\r\n"));
+
+  traceLog.begin();
+  bootLog.begin();
+  bootLog.record(2);
+
+  backtraceLog.report(Serial);
+  Serial.println();
+  bootLog.report(Serial);
+  Serial.println();
+}
+
+void loop(void) {
+  static uint32_t last = 0;
+  if (millis() - last >= 1000) {
+    last = millis();
+    level1(20, 4);
+  }
+
+  if (Serial.available() > 0) {
+    switch (Serial.read()) {
+      case 't':
+        traceLog.report(Serial);
+        break;
+      case 'b':
+        bootLog.report(Serial);
+        break;
+      case 'c':
+        Serial.printf_P(PSTR("Clear traceLog and bootLog\r\n"));
+        traceLog.clear();
+        bootLog.clear();
+        break;
+      case 'r':
+        Serial.printf_P(PSTR("Restart, ESP.restart(); ...\r\n"));
+        ESP.restart();
+        break;
+      case 'z':
+        Serial.println(F("Crashing by dividing by zero."));
+        Serial.printf_P(PSTR("This should not print %d\n"), level1(20, 0));
+        break;
+      default:
+        break;
+    }
+  }
+}
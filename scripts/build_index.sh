@@ -0,0 +1,270 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# A store of .elf files keyed by the '.bin' CRC that BacktraceLog saves with
+# each crash and prints as "Build CRC: 0x...". Archive each release build once,
+# then decode any report against the firmware that produced it, without
+# searching build trees.
+#
+#   build_index.sh add <sketch.ino.elf> [<sketch.ino.bin>]
+#   build_index.sh find <crc>
+#   build_index.sh list
+#   build_index.sh decode [-j] <captured serial output...>
+#   build_index.sh addr2line [-i] <crc>
+#
+# Each build is a directory named by its CRC holding a copy of the .elf, its
+# line table, and build.options.json when found. The line table, lines.tsv, is
+# addr2line's answer for every address where the answer can change, made once
+# by add. symbolize.sh, crash_buckets.sh and crash_archive.sh look PCs up in it
+# through "addr2line" instead of reading the .elf for each batch.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+: ${BACKTRACELOG_INDEX=~/.cache/BacktraceLog/builds}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh add <sketch.ino.elf> [<sketch.ino.bin>]
+    Add a build. The CRC is read from the .bin, by default the one next to the
+    .elf. Prints "<crc> <index directory>".
+
+  $namesh find <crc>
+    Print the path of the indexed .elf for <crc>.
+
+  $namesh list
+    Print "<crc> <date added> <original .elf path>" for each build.
+
+  $namesh decode [-j] <captured serial output...>
+    Decode each capture with symbolize.sh against the build named by its
+    "Build CRC:" line. Captures are batched per build.
+
+  $namesh addr2line [-i] <crc>
+    Read addresses from stdin and print what "addr2line -a -f -C [-i]" prints
+    for the build, from its line table. <crc> may also be a build directory.
+
+  Environment variables and assumed defaults:
+    BACKTRACELOG_INDEX=~/.cache/BacktraceLog/builds
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+# Flash is mapped at 0x40200000, the .bin is an image of flash from offset 0.
+# elf2bin.py stores the CRC at __crc_val. od assumes a little-endian host.
+function bin_crc() {
+  local elf="${1}" bin="${2}" addr
+  addr=$( ${ESP_TOOLCHAIN_NM} "${elf}" | awk '$NF == "__crc_val" { print $1; exit }' )
+  if [[ -z "${addr}" ]]; then
+    echo "${namesh}: __crc_val not found in ${elf}" >&2
+    return 1
+  fi
+  od -An -tx4 -j $(( 0x${addr} - 0x40200000 )) -N4 "${bin}" |
+    awk '{ print "0x" toupper($1) }'
+}
+
+function normalize_crc() {
+  local crc="${1#0x}"
+  crc="${crc#0X}"
+  printf "0x%08X" $(( 0x${crc} ))
+}
+
+# Addresses as 8 lowercase hex digits, no "0x". At a fixed width they sort and
+# compare as strings, mawk has no hex arithmetic.
+function hex8() {
+  awk '{
+    s = tolower($1)
+    sub(/^0x/, "", s)
+    while (length(s) < 8) s = "0" s
+    print substr(s, length(s) - 7)
+  }'
+}
+
+# "<addr><tab><end><tab><function><tab><file:line>[<tab><function><tab><file:line>...]"
+# sorted by address, innermost inline frame first. Between line table rows,
+# function and section starts and ends, addr2line gives one answer; it holds
+# from <addr> up to <end>, the next row.
+function make_lines() {
+  local elf="${1}"
+  {
+    ${ESP_TOOLCHAIN_OBJDUMP} --dwarf=decodedline "${elf}" |
+      awk '{ for (i = 1; i <= NF; i++) if ($i ~ /^0x[0-9a-fA-F]+$/) print $i }'
+    {
+      ${ESP_TOOLCHAIN_OBJDUMP} -h "${elf}"
+      ${ESP_TOOLCHAIN_NM} -n -S --defined-only "${elf}"
+    } |
+      awk '
+        function hex(h,   i, v) {
+          v = 0
+          h = tolower(h)
+          for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+          return v
+        }
+        # printf "%x" in mawk stops at 0x7fffffff
+        function tohex(v,   s) {
+          s = ""
+          do { s = substr("0123456789abcdef", v % 16 + 1, 1) s; v = int(v / 16) } while (v > 0)
+          return s
+        }
+        # Sections, then symbols
+        $1 ~ /^[0-9]+$/ && NF >= 7 { print $4; print tohex(hex($4) + hex($3)) }
+        NF == 3 && $2 ~ /^[tTwW]$/ { print $1 }
+        NF == 4 && $3 ~ /^[tTwW]$/ { print $1; print tohex(hex($1) + hex($2)) }'
+  } | hex8 | sort -u | sed -e 's/^/0x/' |
+    ${ESP_TOOLCHAIN_ADDR2LINE} -aifC -e "${elf}" |
+    awk '
+      function flush() { if ("" != addr) print addr "\t" next_addr row }
+      /^0x[0-9a-f]+$/ {
+        next_addr = substr($0, length($0) - 7)
+        flush()
+        addr = next_addr
+        row = ""
+        next
+      }
+      { row = row "\t" $0 }
+      END { next_addr = addr; flush() }'
+}
+
+function do_add() {
+  local elf="${1}" bin="${2:-${1%.elf}.bin}" crc dir
+  if [[ ! -f "${elf}" || ! -f "${bin}" ]]; then
+    print_help
+    exit 255
+  fi
+  crc=$( bin_crc "${elf}" "${bin}" ) || exit 1
+  dir="${BACKTRACELOG_INDEX}/${crc}"
+  mkdir -p "${dir}" || exit 1
+  cp "${elf}" "${dir}/sketch.ino.elf"
+  rm -f "${dir}/symbols.txt"
+  make_lines "${elf}" >"${dir}/lines.tsv.tmp" &&
+    mv "${dir}/lines.tsv.tmp" "${dir}/lines.tsv" || exit 1
+  if [[ -f "${elf%/*}/build.options.json" ]]; then
+    cp "${elf%/*}/build.options.json" "${dir}/"
+  fi
+  echo "$(date -u +%Y-%m-%dT%H:%M:%SZ) $(realpath "${elf}")" >"${dir}/source.txt"
+  echo "${crc} ${dir}"
+}
+
+function do_find() {
+  local elf="${BACKTRACELOG_INDEX}/$( normalize_crc "${1}" )/sketch.ino.elf"
+  [[ -f "${elf}" ]] || return 1
+  echo "${elf}"
+}
+
+# A merge of the sorted addresses with lines.tsv, one pass over each. Output is
+# in input order, as from addr2line.
+function do_addr2line() {
+  local inline=0 dir
+  if [[ "-i" == "${1}" ]]; then
+    inline=1
+    shift
+  fi
+  if [[ -z "${1}" ]]; then
+    print_help
+    exit 255
+  fi
+  dir="${1}"
+  [[ -d "${dir}" ]] || dir="${BACKTRACELOG_INDEX}/$( normalize_crc "${1}" )"
+  if [[ ! -f "${dir}/sketch.ino.elf" ]]; then
+    echo "${namesh}: build ${1} is not in ${BACKTRACELOG_INDEX}" >&2
+    return 1
+  fi
+  if [[ ! -f "${dir}/lines.tsv" ]]; then
+    # Added before lines.tsv, "add" the build again to make one.
+    ${ESP_TOOLCHAIN_ADDR2LINE} -af$( (( inline )) && echo i )C -e "${dir}/sketch.ino.elf"
+    return
+  fi
+  hex8 | awk '{ print NR "\t" $0 }' | sort -t$'\t' -k2,2 |
+    awk -F'\t' -v inline=${inline} -v lines="${dir}/lines.tsv" '
+      function emit(s) { print idx[q] "\t" s }
+      function unknown() { emit("0x" key[q]); emit("??"); emit("??:0") }
+      {
+        idx[++nq] = $1
+        key[nq] = $2 ""
+      }
+      END {
+        q = 1
+        while (q <= nq && (getline line < lines) > 0) {
+          n = split(line, f, "\t")
+          while (q <= nq && key[q] < f[1] "") { unknown(); q++ }
+          while (q <= nq && key[q] < f[2] "") {
+            emit("0x" key[q])
+            for (i = 3; i < n; i += 2) {
+              emit(f[i])
+              emit(f[i + 1])
+              if (!inline) break
+            }
+            q++
+          }
+        }
+        while (q <= nq) { unknown(); q++ }
+      }' |
+    sort -s -n -t$'\t' -k1,1 | cut -f2-
+}
+
+function do_list() {
+  local dir
+  for dir in "${BACKTRACELOG_INDEX}"/0x*; do
+    [[ -f "${dir}/source.txt" ]] || continue
+    echo "${dir##*/} $(cat "${dir}/source.txt")"
+  done
+}
+
+function do_decode() {
+  local opt="" symbolize crc f
+  if [[ "-j" == "${1}" ]]; then
+    opt="-j"
+    shift
+  fi
+  symbolize="${0%/*}/symbolize.sh"
+  [[ -x "${symbolize}" ]] || symbolize=symbolize.sh
+
+  # "<crc><tab><capture>", then one symbolize.sh call per build.
+  for f in "$@"; do
+    crc=$( sed -n 's/.*Build CRC: \(0x[0-9A-Fa-f]\{8\}\).*/\1/p' "${f}" | head -1 )
+    if [[ -z "${crc}" ]]; then
+      echo "${namesh}: no \"Build CRC:\" line in ${f}" >&2
+      continue
+    fi
+    printf "%s\t%s\n" "$( normalize_crc "${crc}" )" "${f}"
+  done | sort -t$'\t' -k1,1 | awk -F'\t' '
+    $1 != last { if (NR > 1) printf "\n"; printf "%s", $1; last = $1 }
+    { printf "\t%s", $2 }
+    END { if (NR) printf "\n" }' |
+  while IFS=$'\t' read -r crc files; do
+    elf=$( do_find "${crc}" )
+    if [[ -z "${elf}" ]]; then
+      echo "${namesh}: build ${crc} is not in ${BACKTRACELOG_INDEX}" >&2
+      continue
+    fi
+    IFS=$'\t' read -r -a list <<<"${files}"
+    ${symbolize} ${opt} "${elf}" "${list[@]}"
+  done
+}
+
+case "${1}" in
+  add) shift; do_add "$@" ;;
+  find) shift; do_find "$@" || exit 1 ;;
+  list) do_list ;;
+  decode) shift; do_decode "$@" ;;
+  addr2line) shift; do_addr2line "$@" || exit 1 ;;
+  *) print_help; exit 255 ;;
+esac
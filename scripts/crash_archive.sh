@@ -0,0 +1,277 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# An append-only archive of decoded crash records for historical queries,
+# such as all crashes through a function in builds seen after a date. Each
+# report is decoded once, against its build from build_index.sh, when added.
+#
+#   crash_archive.sh add <capture files or directories...>
+#   crash_archive.sh query [-f <function>] [-c <crc>] [-r <reason>]
+#                          [-e <exccause>] [-s <since>] [-u <until>]
+#   crash_archive.sh stats
+#
+# The archive is a directory of tab separated files, only ever appended to:
+#   records/<block>.tsv  <record> <crc> <seen> <reason> <exccause> <pc pc ...>
+#                        <function id ...>, records 1000 * <block> + 1 on
+#   functions.tsv        <function id> <function name>
+#   postings/<id>.txt    the records with the function in their Backtrace,
+#                        ascending, one per line
+#   seen.txt             checksums of the captures already added
+# A query with -f matches the function dictionary, reads the postings of the
+# matching ids only, then only the record blocks holding those records.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+: ${BACKTRACELOG_ARCHIVE=~/.cache/BacktraceLog/archive}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh add <capture files or directories...>
+    Add the reports with a "Build CRC:" line, directories are searched for
+    *.txt and *.log files. A capture already added is skipped.
+
+  $namesh query [-f <function>] [-c <crc>] [-r <reason>] [-e <exccause>]
+               [-s <since>] [-u <until>]
+    Print the matching records, "<record> <crc> <seen> <reason> <exccause>
+    <function < function ...>". <function> is an awk regular expression
+    matched against the demangled names, <since> and <until> are dates as
+    YYYY-MM-DD, compared with the time each capture was written.
+
+  $namesh stats
+    Print the number of records, builds and functions.
+
+  Environment variables and assumed defaults:
+    BACKTRACELOG_ARCHIVE=~/.cache/BacktraceLog/archive
+    BACKTRACELOG_INDEX=~/.cache/BacktraceLog/builds, see build_index.sh
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+build_index="${0%/*}/build_index.sh"
+[[ -x "${build_index}" ]] || build_index=build_index.sh
+
+records="${BACKTRACELOG_ARCHIVE}/records"
+functions="${BACKTRACELOG_ARCHIVE}/functions.tsv"
+postings="${BACKTRACELOG_ARCHIVE}/postings"
+seen="${BACKTRACELOG_ARCHIVE}/seen.txt"
+block_size=1000
+
+# Record blocks in order, by number.
+function record_blocks() {
+  ls "${records}" 2>/dev/null | sed -n 's/^\([0-9][0-9]*\)\.tsv$/\1/p' | sort -n |
+    sed -e "s|.*|${records}/&.tsv|"
+}
+
+# An archive from before records/ and postings/, split in place.
+function upgrade() {
+  local dir="${BACKTRACELOG_ARCHIVE}"
+  if [[ -f "${dir}/records.tsv" ]]; then
+    mkdir -p "${records}" || exit 1
+    awk -F'\t' -v dir="${records}" -v size=${block_size} '
+      { print >>(dir "/" int(($1 - 1) / size) ".tsv") }' "${dir}/records.tsv" &&
+      rm -f "${dir}/records.tsv"
+  fi
+  if [[ -f "${dir}/postings.tsv" ]]; then
+    mkdir -p "${postings}" || exit 1
+    sort -t$'\t' -k1,1n -k2,2n "${dir}/postings.tsv" |
+      awk -F'\t' -v dir="${postings}" '
+        $1 != last { if ("" != out) close(out); out = dir "/" $1 ".txt"; last = $1 }
+        { print $2 >>out }' &&
+      rm -f "${dir}/postings.tsv"
+  fi
+}
+
+function do_add() {
+  local tmp f key crc elf
+  if [[ -z "${1}" ]]; then
+    print_help
+    exit 255
+  fi
+  mkdir -p "${BACKTRACELOG_ARCHIVE}" || exit 1
+  upgrade
+  mkdir -p "${records}" "${postings}" || exit 1
+  touch "${functions}" "${seen}"
+  tmp=$(mktemp -d)
+  trap "rm -rf ${tmp}" EXIT
+
+  # "<crc><tab><seen><tab><reason><tab><exccause><tab><pc pc ...>"
+  for f in "$@"; do
+    if [[ -d "${f}" ]]; then
+      find "${f}" -type f \( -name '*.txt' -o -name '*.log' \) | sort
+    else
+      echo "${f}"
+    fi
+  done |
+    while read -r f; do
+      key=$( cksum <"${f}" | awk '{ print $1 "-" $2 }' )
+      if grep -qxF "${key}" "${seen}" "${tmp}/seen" 2>/dev/null; then
+        continue
+      fi
+      echo "${key}" >>"${tmp}/seen"
+      sed -e 's/\r$//' "${f}" |
+        awk -v seen="$( date -u -r "${f}" +%Y-%m-%dT%H:%M:%SZ )" '
+          /Backtrace Crash Report/ { crc = ""; reason = "-"; cause = "-" }
+          /Build CRC: 0x/ { crc = $0; sub(/.*Build CRC: /, "", crc); crc = "0x" toupper(substr(crc, 3, 8)) }
+          /Reset Reason: / { reason = $NF }
+          /Exception \(/ { cause = $0; sub(/.*Exception \(/, "", cause); sub(/\).*/, "", cause) }
+          /^ *Backtrace: 0x/ && "" != crc {
+            pcs = $0; sub(/.*Backtrace: */, "", pcs)
+            printf "%s\t%s\t%s\t%s\t%s\n", crc, seen, reason, cause, tolower(pcs)
+            crc = ""
+          }'
+    done >"${tmp}/reports"
+
+  # "<crc><tab><pc><tab><function>", one line table lookup per build.
+  for crc in $( cut -f1 "${tmp}/reports" | sort -u ); do
+    elf=$( ${build_index} find "${crc}" )
+    if [[ -z "${elf}" ]]; then
+      echo "${namesh}: build ${crc} is not indexed, its functions are archived as addresses" >&2
+      continue
+    fi
+    awk -v crc="${crc}" -F'\t' '$1 == crc { n = split($5, a, " "); for (i = 1; i <= n; i++) print a[i] }' "${tmp}/reports" |
+      sort -u |
+      ${build_index} addr2line "${crc}" |
+      paste - - - |
+      awk -F'\t' -v crc="${crc}" '{ print crc "\t0x" substr($1, length($1) - 7) "\t" $2 }'
+  done >"${tmp}/symbols"
+
+  # Append to each file, new function names get the next id. Record numbers
+  # only grow, so each postings file stays sorted.
+  awk -F'\t' -v symbols="${tmp}/symbols" -v records="${records}" \
+      -v functions="${functions}" -v postings="${postings}" -v size=${block_size} \
+      -v nrec=$( record_blocks | tail -1 | xargs -r cat | tail -1 | cut -f1 ) '
+    BEGIN {
+      nrec += 0
+      while ((getline line < symbols) > 0) {
+        split(line, f, "\t")
+        fn[f[1], f[2]] = f[3]
+      }
+      while ((getline line < functions) > 0) {
+        split(line, f, "\t")
+        fid[f[2]] = f[1] + 0
+        if (f[1] + 0 > nfid) nfid = f[1] + 0
+      }
+      close(functions)
+    }
+    {
+      ++nrec
+      n = split($5, pcs, " ")
+      ids = ""
+      delete posted
+      for (i = 1; i <= n; i++) {
+        name = fn[$1, pcs[i]]
+        if ("" == name || "??" == name) name = pcs[i]
+        if (!(name in fid)) {
+          fid[name] = ++nfid
+          printf "%d\t%s\n", nfid, name >>functions
+        }
+        ids = ids ((i > 1) ? " " : "") fid[name]
+        if (!(fid[name] in posted)) {
+          posted[fid[name]] = 1
+          out = postings "/" fid[name] ".txt"
+          print nrec >>out
+          close(out)
+        }
+      }
+      out = records "/" int((nrec - 1) / size) ".tsv"
+      if (out != block) {
+        if ("" != block) close(block)
+        block = out
+      }
+      printf "%d\t%s\t%s\n", nrec, $0, ids >>block
+    }
+    END { print NR " reports added" }' "${tmp}/reports" &&
+    cat "${tmp}/seen" >>"${seen}" 2>/dev/null
+}
+
+function do_query() {
+  local func="" crc="" reason="" cause="" since="" until="" want blocks
+  while [[ -n "${1}" ]]; do
+    case "${1}" in
+      -f) func="${2}" ;;
+      -c) crc=$( printf "0x%08X" $(( 0x${2#0x} )) ) ;;
+      -r) reason="${2}" ;;
+      -e) cause="${2}" ;;
+      -s) since="${2}" ;;
+      -u) until="${2}" ;;
+      *) print_help; exit 255 ;;
+    esac
+    shift 2
+  done
+  [[ -d "${BACKTRACELOG_ARCHIVE}" ]] || return
+  upgrade
+  [[ -d "${records}" ]] || return
+
+  # Records holding a matching function, from the postings of the matching
+  # ids, and the blocks that hold them.
+  want=$(mktemp)
+  blocks=$(mktemp)
+  trap "rm -f ${want} ${blocks}" EXIT
+  if [[ -n "${func}" ]]; then
+    awk -F'\t' -v re="${func}" -v dir="${postings}" '$2 ~ re { print dir "/" $1 ".txt" }' "${functions}" |
+      xargs -r cat | sort -n -u >"${want}"
+    [[ -s "${want}" ]] || return
+    awk -v dir="${records}" -v size=${block_size} '
+      { b = int(($1 - 1) / size) } 1 == NR || b != last { print dir "/" b ".tsv"; last = b }' "${want}" >"${blocks}"
+  else
+    record_blocks >"${blocks}"
+  fi
+  [[ -s "${blocks}" ]] || return
+
+  awk -F'\t' -v want="${want}" -v functions="${functions}" -v crc="${crc}" \
+      -v reason="${reason}" -v cause="${cause}" -v since="${since}" -v until="${until}" '
+    BEGIN {
+      while ((getline line < want) > 0) {
+        rec[line] = 1
+        any = 1
+      }
+      while ((getline line < functions) > 0) {
+        split(line, f, "\t")
+        name[f[1]] = f[2]
+      }
+    }
+    any && !($1 in rec) { next }
+    "" != crc && $2 != crc { next }
+    "" != reason && $4 != reason { next }
+    "" != cause && $5 != cause { next }
+    "" != since && substr($3, 1, length(since)) < since { next }
+    "" != until && substr($3, 1, length(until)) > until { next }
+    {
+      n = split($7, ids, " ")
+      s = ""
+      for (i = 1; i <= n; i++) s = s ((i > 1) ? " < " : "") name[ids[i]]
+      printf "%s %s %s %s %s %s\n", $1, $2, $3, $4, $5, s
+    }' $( cat "${blocks}" )
+}
+
+function do_stats() {
+  [[ -d "${BACKTRACELOG_ARCHIVE}" ]] || return
+  upgrade
+  [[ -d "${records}" ]] || return
+  echo "records:   $( record_blocks | xargs -r cat | wc -l )"
+  echo "builds:    $( record_blocks | xargs -r cat | cut -f2 | sort -u | wc -l )"
+  echo "functions: $( wc -l <"${functions}" )"
+}
+
+case "${1}" in
+  add) shift; do_add "$@" ;;
+  query) shift; do_query "$@" ;;
+  stats) do_stats ;;
+  *) print_help; exit 255 ;;
+esac
@@ -0,0 +1,244 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Group crash reports from many devices into buckets of the same crash. Each
+# report is decoded against its build, found through build_index.sh by its
+# "Build CRC:" line, and bucketed by a signature made of the reset reason,
+# the exception cause and the top function names of the Backtrace. Counts and
+# first and last seen times are kept per bucket and build in a TSV file.
+#
+#   crash_buckets.sh add [-P <jobs>] <capture files or directories...>
+#   crash_buckets.sh top [-n <count>] [<crc>]
+#   crash_buckets.sh show <bucket>
+#
+# Function names, not addresses, make up the signature, so the same crash
+# lands in the same bucket across builds.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+: ${BACKTRACELOG_BUCKETS=~/.cache/BacktraceLog/buckets.tsv}
+: ${BACKTRACELOG_DEPTH=4}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh add [-P <jobs>] <capture files or directories...>
+    Add the reports in the captures, directories are searched for *.txt and
+    *.log files. Builds are decoded in parallel, <jobs> at a time, default
+    the number of CPUs. A capture already added is skipped.
+
+  $namesh top [-n <count>] [<crc>]
+    Print the <count> largest buckets, default 20, over all builds or for
+    build <crc>: "<bucket> <reports> <builds> <first seen> <last seen>
+    <signature>".
+
+  $namesh show <bucket>
+    Print the per build counts of a bucket.
+
+  Environment variables and assumed defaults:
+    BACKTRACELOG_BUCKETS=~/.cache/BacktraceLog/buckets.tsv
+    BACKTRACELOG_DEPTH=4, functions in a signature
+    BACKTRACELOG_INDEX=~/.cache/BacktraceLog/builds, see build_index.sh
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+build_index="${0%/*}/build_index.sh"
+[[ -x "${build_index}" ]] || build_index=build_index.sh
+
+# "<crc> <pc> <pc> ..." -> "<pc><tab><function>" for the build, one pass
+# over its line table from build_index.sh.
+function decode_build() {
+  local crc="${1}" reports="${2}" out="${3}" elf
+  elf=$( ${build_index} find "${crc}" )
+  if [[ -z "${elf}" ]]; then
+    echo "${namesh}: build ${crc} is not indexed, its reports are bucketed by address" >&2
+    : >"${out}"
+    return
+  fi
+  awk -v crc="${crc}" -F'\t' '$1 == crc { n = split($5, a, " "); for (i = 1; i <= n; i++) print a[i] }' "${reports}" |
+    sort -u |
+    ${build_index} addr2line "${crc}" |
+    paste - - - |
+    awk -F'\t' '{ print "0x" substr($1, length($1) - 7) "\t" $2 }' >"${out}"
+}
+
+function do_add() {
+  local jobs=$(nproc 2>/dev/null || echo 2) tmp f crc key
+  if [[ "-P" == "${1}" ]]; then
+    jobs="${2}"
+    shift 2
+  fi
+  if [[ -z "${1}" ]]; then
+    print_help
+    exit 255
+  fi
+  mkdir -p "${BACKTRACELOG_BUCKETS%/*}" || exit 1
+  touch "${BACKTRACELOG_BUCKETS}" "${BACKTRACELOG_BUCKETS}.seen"
+  tmp=$(mktemp -d)
+  trap "rm -rf ${tmp}" EXIT
+
+  # One line per report:
+  #   "<crc><tab><seen><tab><reason><tab><exccause><tab><pc pc ...>"
+  # A capture is known by the checksum of its contents.
+  for f in "$@"; do
+    if [[ -d "${f}" ]]; then
+      find "${f}" -type f \( -name '*.txt' -o -name '*.log' \) | sort
+    else
+      echo "${f}"
+    fi
+  done |
+    while read -r f; do
+      key=$( cksum <"${f}" | awk '{ print $1 "-" $2 }' )
+      if grep -qxF "${key}" "${BACKTRACELOG_BUCKETS}.seen" "${tmp}/seen" 2>/dev/null; then
+        continue
+      fi
+      echo "${key}" >>"${tmp}/seen"
+      sed -e 's/\r$//' "${f}" |
+        awk -v seen="$( date -u -r "${f}" +%Y-%m-%dT%H:%M:%SZ )" '
+          /Backtrace Crash Report/ { crc = ""; reason = "-"; cause = "-" }
+          /Build CRC: 0x/ { crc = $0; sub(/.*Build CRC: /, "", crc); crc = toupper(substr(crc, 3, 8)); crc = "0x" crc }
+          /Reset Reason: / { reason = $NF }
+          /Exception \(/ { cause = $0; sub(/.*Exception \(/, "", cause); sub(/\).*/, "", cause) }
+          /^ *Backtrace: 0x/ && "" != crc {
+            pcs = $0; sub(/.*Backtrace: */, "", pcs)
+            printf "%s\t%s\t%s\t%s\t%s\n", crc, seen, reason, cause, tolower(pcs)
+            crc = ""
+          }'
+    done >"${tmp}/reports"
+
+  if [[ ! -s "${tmp}/reports" ]]; then
+    echo "${namesh}: no new reports with a \"Build CRC:\" line" >&2
+    cat "${tmp}/seen" >>"${BACKTRACELOG_BUCKETS}.seen" 2>/dev/null
+    return
+  fi
+
+  # Decode each build in parallel.
+  for crc in $( cut -f1 "${tmp}/reports" | sort -u ); do
+    while (( $( jobs -rp | wc -l ) >= jobs )); do
+      wait -n
+    done
+    decode_build "${crc}" "${tmp}/reports" "${tmp}/${crc}.sym" &
+  done
+  wait
+
+  # Signature from the symbols, then merge into the store:
+  #   "<bucket><tab><crc><tab><count><tab><first><tab><last><tab><signature>"
+  awk -F'\t' -v dir="${tmp}" -v depth="${BACKTRACELOG_DEPTH}" -v store="${BACKTRACELOG_BUCKETS}" '
+    function load(crc,   file, line, f) {
+      if (crc in loaded) return
+      loaded[crc] = 1
+      file = dir "/" crc ".sym"
+      while ((getline line < file) > 0) {
+        split(line, f, "\t")
+        fn[crc, f[1]] = f[2]
+      }
+      close(file)
+    }
+    # Compiler clones of a function are the same function.
+    function normalize(name) {
+      sub(/\.(constprop|isra|part|lto_priv|cold)\.[0-9]+.*$/, "", name)
+      return name
+    }
+    # A short, stable name for a signature. mawk has no bit operations and
+    # printf "%x" is limited to 31 bits, so a polynomial hash mod 2^31 - 1.
+    function bucket_id(s,   i, h) {
+      h = 0
+      for (i = 1; i <= length(s); i++) h = (h * 31 + index(chars, substr(s, i, 1))) % 2147483647
+      return sprintf("%08x", h)
+    }
+    BEGIN {
+      for (i = 32; i < 127; i++) chars = chars sprintf("%c", i)
+      while ((getline line < store) > 0) {
+        split(line, f, "\t")
+        k = f[1] SUBSEP f[2]
+        count[k] = f[3]; first[k] = f[4]; last[k] = f[5]; sig[k] = f[6]
+        order[++nk] = k
+      }
+      close(store)
+    }
+    {
+      load($1)
+      n = split($5, pcs, " ")
+      s = "reason " $3
+      if ("-" != $4) s = s ", exception " $4
+      s = s ":"
+      used = 0
+      for (i = 1; i <= n && used < depth; i++) {
+        name = fn[$1, pcs[i]]
+        if ("" == name || "??" == name) name = pcs[i]
+        s = s ((used++) ? " < " : " ") normalize(name)
+      }
+      k = bucket_id(s) SUBSEP $1
+      if (!(k in count)) {
+        order[++nk] = k
+        count[k] = 0; first[k] = $2; last[k] = $2; sig[k] = s
+      }
+      count[k]++
+      if ($2 < first[k]) first[k] = $2
+      if ($2 > last[k]) last[k] = $2
+    }
+    END {
+      for (i = 1; i <= nk; i++) {
+        k = order[i]
+        split(k, id, SUBSEP)
+        printf "%s\t%s\t%d\t%s\t%s\t%s\n", id[1], id[2], count[k], first[k], last[k], sig[k]
+      }
+    }' "${tmp}/reports" >"${tmp}/store" &&
+    mv "${tmp}/store" "${BACKTRACELOG_BUCKETS}" &&
+    cat "${tmp}/seen" >>"${BACKTRACELOG_BUCKETS}.seen"
+  echo "$( wc -l <"${tmp}/reports" ) reports added"
+}
+
+function do_top() {
+  local count=20
+  if [[ "-n" == "${1}" ]]; then
+    count="${2}"
+    shift 2
+  fi
+  [[ -f "${BACKTRACELOG_BUCKETS}" ]] || return
+  awk -F'\t' -v crc="${1:+$( printf "0x%08X" $(( 0x${1#0x} )) )}" '
+    "" != crc && $2 != crc { next }
+    {
+      if (!($1 in total)) { first[$1] = $4; last[$1] = $5; sig[$1] = $6 }
+      total[$1] += $3
+      builds[$1]++
+      if ($4 < first[$1]) first[$1] = $4
+      if ($5 > last[$1]) last[$1] = $5
+    }
+    END {
+      for (b in total) printf "%s\t%d\t%d\t%s\t%s\t%s\n", b, total[b], builds[b], first[b], last[b], sig[b]
+    }' "${BACKTRACELOG_BUCKETS}" |
+    sort -t$'\t' -k2,2nr -k5,5r | head -n "${count}" | tr '\t' ' '
+}
+
+function do_show() {
+  [[ -n "${1}" && -f "${BACKTRACELOG_BUCKETS}" ]] || { print_help; exit 255; }
+  awk -F'\t' -v id="${1}" '
+    $1 == id {
+      if (!shown++) print $6
+      printf "  %s %6d  %s  %s\n", $2, $3, $4, $5
+    }' "${BACKTRACELOG_BUCKETS}"
+}
+
+case "${1}" in
+  add) shift; do_add "$@" ;;
+  top) shift; do_top "$@" ;;
+  show) shift; do_show "$@" ;;
+  *) print_help; exit 255 ;;
+esac
@@ -0,0 +1,218 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Fill in the on-device symbol table, reserved by building with
+# -DDEBUG_ESP_BACKTRACELOG_SYMBOLS=<bytes>. Run after linking and before
+# elf2bin.py, so the .bin and its CRC include the table. See
+# src/BacktraceSymbols.cpp for the layout.
+#
+#   embed_symbols.sh <sketch.ino.elf>
+#   embed_symbols.sh -l <sketch.ino.elf> <address...>
+#
+# With -l, nothing is written; each address is looked up in the table already
+# in the .elf, the same way the device does, to check a build.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh <sketch.ino.elf>
+    Write the symbol table into the .elf. Prints the functions and bytes
+    used; fails, changing nothing, when the table does not fit.
+
+  $namesh -l <sketch.ino.elf> <address...>
+    Look up each address in the table in the .elf, print
+    "<address> <function>+<offset>" or "<address> ??".
+
+  For the Arduino IDE, add to platform.local.txt:
+    recipe.hooks.objcopy.preobjcopy.1.pattern=bash "<path to BacktraceLog>/scripts/$namesh" "{build.path}/{build.project_name}.elf"
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+
+EOF
+}
+
+lookup=false
+if [[ "-l" == "${1}" ]]; then
+  lookup=true
+  shift
+fi
+if [[ ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+shift
+
+# Address and size of the reserved table, then its offset in the .elf file
+# from the section holding it.
+read -r table_addr table_size < <(
+  ${ESP_TOOLCHAIN_NM} -S "${elf}" | awk '$NF == "backtraceLog_symbols" { print $1, $2; exit }' )
+if [[ -z "${table_addr}" ]]; then
+  echo "${namesh}: backtraceLog_symbols not found, build with -DDEBUG_ESP_BACKTRACELOG_SYMBOLS=<bytes>" >&2
+  exit 1
+fi
+table_offset=$( ${ESP_TOOLCHAIN_OBJDUMP} -h "${elf}" |
+  awk -v addr=$(( 0x${table_addr} )) '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    $1 ~ /^[0-9]+$/ && NF >= 7 {
+      vma = hex($4)
+      if (addr >= vma && addr < vma + hex($3)) { print hex($6) + addr - vma; exit }
+    }' )
+if [[ -z "${table_offset}" ]]; then
+  echo "${namesh}: no section holds backtraceLog_symbols" >&2
+  exit 1
+fi
+table_size=$(( 0x${table_size} ))
+
+if ${lookup}; then
+  od -An -v -tu1 -j ${table_offset} -N ${table_size} "${elf}" |
+    awk -v addrs="$*" '
+      function hex(h,   i, v) {
+        v = 0
+        h = tolower(h)
+        sub(/^0x/, "", h)
+        for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+        return v
+      }
+      function u32(o) { return b[o] + 256 * (b[o + 1] + 256 * (b[o + 2] + 256 * b[o + 3])) }
+      function u16(o) { return b[o] + 256 * b[o + 1] }
+      # Same steps as backtraceLog_symbol()
+      function symbol(pc,   count, lo, hi, mid, i, off, p, j, len, shared, n, k, name) {
+        count = u32(4)
+        lo = 0; hi = count
+        while (lo < hi) {
+          mid = int((lo + hi) / 2)
+          if (u32(24 + 4 * mid) <= pc) lo = mid + 1
+          else hi = mid
+        }
+        if (0 == lo) return ""
+        i = lo - 1
+        off = pc - u32(24 + 4 * i)
+        if (off >= u16(u32(8) + 2 * i)) return ""
+        p = u32(16) + u32(u32(12) + 4 * int(i / 16))
+        name = ""
+        for (j = i - i % 16; j <= i; j++) {
+          shared = b[p++]; n = b[p++]
+          name = substr(name, 1, shared)
+          for (k = 0; k < n; k++) name = name chars[b[p++]]
+        }
+        return sprintf("%s+0x%x", name, off)
+      }
+      BEGIN { for (i = 32; i < 127; i++) chars[i] = sprintf("%c", i) }
+      { for (i = 1; i <= NF; i++) b[nb++] = $i + 0 }
+      END {
+        if (1498633282 != u32(0)) {
+          print "symbol table not filled in" > "/dev/stderr"
+          exit 1
+        }
+        n = split(addrs, a, " ")
+        for (i = 1; i <= n; i++) {
+          s = symbol(hex(a[i]))
+          printf "0x%08x %s\n", hex(a[i]), ("" == s) ? "??" : s
+        }
+      }'
+  exit
+fi
+
+# Functions in IRAM and flash, ascending. Parameter lists are dropped, they
+# cost the most space and the address already picks the overload. A symbol
+# without a size runs to the next one.
+table=$(mktemp)
+trap "rm -f ${table}" EXIT
+${ESP_TOOLCHAIN_NM} -n -S -C --defined-only "${elf}" |
+  LC_ALL=C awk -v size=${table_size} '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    function short_name(s,   i) {
+      for (i = 1; i <= length(s); i++) {
+        if ("(" == substr(s, i, 1) && substr(s, 1, i - 1) !~ /operator$/) return substr(s, 1, i - 1) "()"
+      }
+      return s
+    }
+    function put8(v) { out[nb++] = v % 256 }
+    function put16(v) { put8(v); put8(int(v / 256)) }
+    function put32(v) { put16(v % 65536); put16(int(v / 65536)) }
+    function align4() { while (nb % 4) put8(0) }
+    {
+      # "<addr> <size> <type> <name...>" or "<addr> <type> <name...>"
+      if (4 <= NF && $3 ~ /^[tTwW]$/) { a = hex($1); sz = hex($2); rest = $0; for (k = 1; k <= 3; k++) sub(/^ *[^ ]+ /, "", rest) }
+      else if ($2 ~ /^[tTwW]$/) { a = hex($1); sz = 0; rest = $0; for (k = 1; k <= 2; k++) sub(/^ *[^ ]+ /, "", rest) }
+      else next
+      if (a < 1074790400 || a >= 1076887552) next     # 0x40100000 - 0x40300000
+      if (n && a == addr[n]) { if (!fsize[n]) fsize[n] = sz; next }
+      addr[++n] = a; fsize[n] = sz; name[n] = substr(short_name(rest), 1, 255)
+    }
+    END {
+      for (i = 1; i <= n; i++) {
+        if (!fsize[i]) fsize[i] = (i < n) ? addr[i + 1] - addr[i] : 1
+        if (fsize[i] > 65535) fsize[i] = 65535
+      }
+      nrestart = int((n + 15) / 16)
+      sizes = 24 + 4 * n
+      restarts = sizes + 4 * int((n + 1) / 2)
+      names = restarts + 4 * nrestart
+      # Name entries first, to know the restart offsets and the size.
+      prev = ""
+      for (i = 1; i <= n; i++) {
+        s = name[i]
+        shared = 0
+        if ((i - 1) % 16) {
+          while (shared < length(prev) && shared < length(s) && shared < 255 && substr(prev, shared + 1, 1) == substr(s, shared + 1, 1)) shared++
+        } else {
+          restart[(i - 1) / 16] = nameb
+        }
+        entry[i] = shared
+        nameb += 2 + length(s) - shared
+        prev = s
+      }
+      used = names + nameb
+      if (used > size) {
+        printf "Symbol table needs %u bytes, only %u reserved. Rebuild with -DDEBUG_ESP_BACKTRACELOG_SYMBOLS=%u\n", used, size, int((used + 1023) / 1024) * 1024 > "/dev/stderr"
+        exit 1
+      }
+      put32(1498633282); put32(n); put32(sizes); put32(restarts); put32(names); put32(used)
+      for (i = 1; i <= n; i++) put32(addr[i])
+      for (i = 1; i <= n; i++) put16(fsize[i])
+      align4()
+      for (i = 0; i < nrestart; i++) put32(restart[i])
+      for (i = 1; i <= n; i++) {
+        s = name[i]
+        put8(entry[i]); put8(length(s) - entry[i])
+        for (k = entry[i] + 1; k <= length(s); k++) out[nb++] = code[substr(s, k, 1)]
+      }
+      printf "%u functions, %u of %u bytes\n", n, used, size > "/dev/stderr"
+      for (i = 0; i < nb; i++) printf "\\0%03o", out[i]
+    }
+    BEGIN { for (i = 1; i < 256; i++) code[sprintf("%c", i)] = i }' >"${table}" || exit 1
+
+printf "%b" "$(cat "${table}")" |
+  dd of="${elf}" bs=1 seek=${table_offset} conv=notrunc 2>/dev/null
@@ -0,0 +1,117 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Summarize the "Histogram:" lines printed by
+# backtraceLog_instrument_histogram_dump(). One line per function, sorted by
+# estimated total time, with call count and approximate median, 99th percentile
+# and maximum in microseconds.
+#
+#   histogram_report.sh [-v] <sketch.ino.elf> [captured serial output]
+#
+# All addresses are symbolized with a single call to addr2line.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+: ${ESP_CPU_MHZ=80}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-v] <sketch.ino.elf> [captured serial output]
+
+  Reads from stdin when no capture file is given.
+
+    -v  also print each function's histogram, one bucket per line.
+
+  Times are bucket upper bounds, calls taking [2^(b-1), 2^b) cycles are
+  counted in bucket b.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+    ESP_CPU_MHZ=80
+
+EOF
+}
+
+verbose=false
+if [[ "-v" == "${1}" ]]; then
+  verbose=true
+  shift
+fi
+if [[ "--help" == "${1}" || ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+capture="${2:--}"
+
+histogram=$(mktemp)
+symbols=$(mktemp)
+trap "rm -f $histogram $symbols" EXIT
+
+# Keep "<fn> <bucket>:<count> ...", dropping any serial noise ahead of the tag.
+sed -n -e 's/\r$//' \
+  -e 's/.*Histogram: \(0x[0-9a-f]\{8\}\( [0-9]\+:[0-9]\+\)*\).*/\1/p' "${capture}" >$histogram
+
+cut -d' ' -f1 $histogram | sort -u |
+  ${ESP_TOOLCHAIN_ADDR2LINE} -afC -e "${elf}" |
+  paste - - - >$symbols
+
+awk -v symbols=$symbols -v mhz=${ESP_CPU_MHZ} -v verbose=$verbose '
+  BEGIN {
+    while ((getline line < symbols) > 0) {
+      split(line, f, "\t")
+      if ("??" != f[2]) name[f[1]] = f[2]
+    }
+  }
+  function usec(b) {
+    return (0 == b) ? 0 : (2 ^ b) / mhz
+  }
+  {
+    # The same function may show up in several captures, add them up.
+    fn = $1
+    for (i = 2; i <= NF; i++) {
+      split($i, bc, ":")
+      count[fn, bc[1]] += bc[2]
+      calls[fn] += bc[2]
+      if (bc[1] > top[fn]) top[fn] = bc[1]
+    }
+  }
+  END {
+    for (fn in calls) {
+      k++
+      total = 0; p50 = ""; p99 = ""; seen = 0
+      for (b = 0; b <= top[fn]; b++) {
+        n = count[fn, b] + 0
+        # Midpoint of the bucket
+        total += n * ((0 == b) ? 0 : 1.5 * 2 ^ (b - 1)) / mhz
+        seen += n
+        if ("" == p50 && seen * 2 >= calls[fn]) p50 = usec(b)
+        if ("" == p99 && seen * 100 >= calls[fn] * 99) p99 = usec(b)
+      }
+      label = (fn in name) ? name[fn] : fn
+      printf "%12.1f %d %10d %10.2f %10.2f %10.2f  %s\n", total, k, calls[fn], p50, p99, usec(top[fn]), label
+      if ("true" == verbose) {
+        for (b = 0; b <= top[fn]; b++) {
+          if (count[fn, b]) printf "%12.1f %d            %10s %10.2f %10d\n", total, k, "<=", usec(b), count[fn, b]
+        }
+      }
+    }
+  }' $histogram |
+  sort -s -k1,1nr -k2,2n |
+  awk 'BEGIN { printf "%10s %10s %10s %10s  %s\n", "calls", "p50 us", "p99 us", "max us", "function" }
+       { sub(/^ *[^ ]+ [^ ]+ /, ""); print }'
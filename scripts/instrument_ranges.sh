@@ -0,0 +1,113 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Create address ranges for the DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER table
+# from the functions in a .elf that match one or more extended regular
+# expressions.
+#
+#   instrument_ranges.sh [-c] [-f] <sketch.ino.elf> <regex> [<regex>...]
+#
+# Functions next to each other are merged into one range.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-c] [-f] <sketch.ino.elf> <regex> [<regex>...]
+
+  Prints "<start> <end>" hex address pairs, one range per line, for the
+  functions whose (demangled) name matches any <regex>.
+
+    -f  match <regex> against the source file path instead of the function name.
+        Uses debug line info, slower.
+    -c  print calls to backtraceLog_instrument_filter_add() for pasting into a
+        sketch.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+
+EOF
+}
+
+c_out=false
+by_file=false
+while [[ "${1:0:1}" == "-" ]]; do
+  case "${1}" in
+    -c) c_out=true ;;
+    -f) by_file=true ;;
+    *) print_help; exit 255 ;;
+  esac
+  shift
+done
+
+if [[ ! -f "${1}" || -z "${2}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+shift
+pattern=$(IFS='|'; echo "$*")
+
+if $by_file; then
+  nm_args="-l"
+else
+  nm_args=""
+fi
+
+# "<addr> <size> <type> <name>[<tab><file:line>]", sorted by address. Keep
+# functions only, type t or T.
+${ESP_TOOLCHAIN_NM} -n -S -C --defined-only $nm_args "${elf}" |
+  awk -v pattern="${pattern}" -v by_file=$by_file -v c_out=$c_out '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    function flush() {
+      if ("" == start) return
+      if ("true" == c_out) {
+        printf "  backtraceLog_instrument_filter_add((const void*)0x%08x, (const void*)0x%08x);\n", start, end
+      } else {
+        printf "0x%08x 0x%08x\n", start, end
+      }
+    }
+    $3 ~ /^[tT]$/ {
+      if ("true" == by_file) {
+        n = split($0, f, "\t")
+        subject = (n > 1) ? f[n] : ""
+      } else {
+        subject = $0
+        sub(/^[^ ]+ [^ ]+ [^ ]+ /, "", subject)
+        sub(/\t.*$/, "", subject)
+      }
+      if (subject !~ pattern) next
+      s = hex($1)
+      e = s + hex($2)
+      if (s == e) next
+      # Allow for alignment padding between functions
+      if ("" != start && s <= end + 3) {
+        if (e > end) end = e
+        next
+      }
+      flush()
+      start = s
+      end = e
+    }
+    END { flush() }'
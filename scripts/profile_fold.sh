@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Fold the "Profile:" lines printed by backtraceLog_profile_dump() into the
+# collapsed stack format read by flame graph tools (flamegraph.pl, speedscope).
+#
+#   profile_fold.sh <sketch.ino.elf> [captured serial output] >profile.folded
+#   flamegraph.pl profile.folded >profile.svg
+#
+# All addresses are symbolized with a single call to addr2line.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh <sketch.ino.elf> [captured serial output]
+
+  Reads from stdin when no capture file is given.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+if [[ "--help" == "${1}" || ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+capture="${2:--}"
+
+profile=$(mktemp)
+symbols=$(mktemp)
+trap "rm -f $profile $symbols" EXIT
+
+# Keep "<count> <pc> ...", dropping any serial noise ahead of the tag.
+sed -n -e 's/\r$//' \
+  -e 's/.*Profile: \([0-9]\+\( 0x[0-9a-f]\{8\}\)*\).*/\1/p' "${capture}" >$profile
+
+cut -d' ' -f2- $profile | tr ' ' '\n' | sort -u |
+  ${ESP_TOOLCHAIN_ADDR2LINE} -afC -e "${elf}" |
+  paste - - - >$symbols
+
+# Outermost call first, as the folded format expects. Unknown addresses, like
+# the Boot ROM, are left as hex. Call stacks that only differ by return
+# address within the same functions are merged.
+awk -v symbols=$symbols '
+  BEGIN {
+    while ((getline line < symbols) > 0) {
+      split(line, f, "\t")
+      if ("??" != f[2]) name[f[1]] = f[2]
+    }
+  }
+  {
+    stack = ""
+    for (i = NF; i >= 2; i--) {
+      fn = ($i in name) ? name[$i] : $i
+      stack = ("" == stack) ? fn : stack ";" fn
+    }
+    folded[stack] += $1
+  }
+  END {
+    for (s in folded) print s, folded[s]
+  }' $profile | sort
@@ -0,0 +1,212 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Remap code addresses from one build to another. When a report's "Build CRC:"
+# does not match the current build, its addresses mean nothing against the
+# current .elf. Each PC is placed in its function in the old build, then the
+# same function, by its linker symbol, is found in the new build:
+#
+#   exact    the function is the same size, the PC keeps its offset
+#   line     the first address in the new function for the same source line
+#   nearest  the address in the new function with the closest line
+#   function the function start, no line information in the new function
+#   none     the function is not in the new build
+#
+#   remap_build.sh [-r] <old.elf> <new.elf> [captured serial output | address...]
+#
+# objdump is run only for functions that changed size.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-r] <old.elf> <new.elf> [captured serial output | address...]
+
+  Reads from stdin when no capture or address is given. Prints
+  "<old pc> <new pc> <how> <function>+<offset> at <old file:line>".
+
+    -r  rewrite the capture instead, each address replaced with its new
+        address, or left as is when it cannot be remapped.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+rewrite=false
+if [[ "-r" == "${1}" ]]; then
+  rewrite=true
+  shift
+fi
+if [[ ! -f "${1}" || ! -f "${2}" ]]; then
+  print_help
+  exit 255
+fi
+old_elf="${1}"
+new_elf="${2}"
+shift 2
+
+tmp=$(mktemp -d)
+trap "rm -rf ${tmp}" EXIT
+
+# The input, kept for -r.
+if [[ -z "${1}" ]]; then
+  sed -e 's/\r$//' >"${tmp}/input"
+elif [[ -f "${1}" ]]; then
+  sed -e 's/\r$//' "${1}" >"${tmp}/input"
+else
+  echo "$*" >"${tmp}/input"
+fi
+grep -oE '0x40[0-9a-fA-F]{6}' "${tmp}/input" | tr 'A-F' 'a-f' | sort -u >"${tmp}/pcs"
+[[ -s "${tmp}/pcs" ]] || exit 0
+
+# "<start> <size> <symbol>", by the linker symbol, not demangled.
+function functions() {
+  ${ESP_TOOLCHAIN_NM} -n -S --defined-only "${1}" |
+    awk '$3 ~ /^[tTwW]$/ && $2 !~ /^0+$/ { print $1, $2, $4 }'
+}
+functions "${old_elf}" >"${tmp}/old_fn"
+functions "${new_elf}" >"${tmp}/new_fn"
+
+# "<pc><tab><function><tab><file:line>" in the old build, one addr2line call.
+${ESP_TOOLCHAIN_ADDR2LINE} -afC -e "${old_elf}" <"${tmp}/pcs" |
+  paste - - - |
+  awk -F'\t' '{ print "0x" substr($1, length($1) - 7) "\t" $2 "\t" $3 }' >"${tmp}/old_src"
+
+# "<pc> <symbol> <offset> <file:line> <new start> <new size> <old size>",
+# tab separated, file names may have spaces. A symbol
+# defined more than once, a static function in several files, prefers a
+# same size match.
+awk -v old_fn="${tmp}/old_fn" -v new_fn="${tmp}/new_fn" -v old_src="${tmp}/old_src" '
+  function hex(h,   i, v) {
+    v = 0
+    h = tolower(h)
+    sub(/^0x/, "", h)
+    for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+    return v
+  }
+  BEGIN {
+    while ((getline line < old_fn) > 0) {
+      split(line, f, " ")
+      start[++n] = hex(f[1]); size[n] = hex(f[2]); sym[n] = f[3]
+    }
+    while ((getline line < new_fn) > 0) {
+      split(line, f, " ")
+      k = f[3]
+      nnew[k]++
+      new_start[k, nnew[k]] = hex(f[1]); new_size[k, nnew[k]] = hex(f[2])
+    }
+    while ((getline line < old_src) > 0) {
+      split(line, f, "\t")
+      src[f[1]] = f[3]
+    }
+  }
+  {
+    pc = hex($1)
+    lo = 1; hi = n; found = 0
+    while (lo <= hi) {
+      mid = int((lo + hi) / 2)
+      if (pc < start[mid]) hi = mid - 1
+      else if (pc >= start[mid] + size[mid]) lo = mid + 1
+      else { found = mid; break }
+    }
+    if (!found) { printf "%s\t??\t0\t?\t0\t0\t0\n", $1; next }
+    k = sym[found]
+    best = 0
+    for (i = 1; i <= nnew[k]; i++) {
+      if (!best || new_size[k, i] == size[found]) best = i
+    }
+    line = src[$1]; if ("" == line) line = "?"
+    sub(/ \(discriminator [0-9]+\)$/, "", line)
+    if (best) printf "%s\t%s\t%d\t%s\t%d\t%d\t%d\n", $1, k, pc - start[found], line, new_start[k, best], new_size[k, best], size[found]
+    else printf "%s\t%s\t%d\t%s\t0\t0\t%d\n", $1, k, pc - start[found], line, size[found]
+  }' "${tmp}/pcs" >"${tmp}/placed"
+
+# Source lines of each function that changed size, one objdump call each:
+# "<new start><tab><address><tab><file:line>"
+awk -F'\t' '$5 && $6 != $7 { print $5, $6 }' "${tmp}/placed" | sort -u |
+  while read -r start size; do
+    ${ESP_TOOLCHAIN_OBJDUMP} -d -l --start-address=${start} --stop-address=$(( start + size )) "${new_elf}" |
+      awk -v start=${start} '
+        /^\/.*:[0-9]+/ || /^[^ \t].*\.[a-zA-Z]+:[0-9]+/ { line = $0; sub(/ \(discriminator [0-9]+\)$/, "", line); next }
+        /^ *[0-9a-f]+:\t/ && "" != line { a = $1; sub(/:$/, "", a); print start "\t" a "\t" line; line = "" }'
+  done >"${tmp}/new_lines"
+
+awk -F'\t' -v new_lines="${tmp}/new_lines" -v old_src="${tmp}/old_src" -v rewrite=${rewrite} \
+    -v input="${tmp}/input" '
+  function hex(h,   i, v) {
+    v = 0
+    h = tolower(h)
+    sub(/^0x/, "", h)
+    for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+    return v
+  }
+  function file_of(s) { sub(/:[0-9?]+$/, "", s); sub(/^.*\//, "", s); return s }
+  function line_of(s) { sub(/^.*:/, "", s); return s + 0 }
+  BEGIN {
+    while ((getline l < new_lines) > 0) {
+      split(l, f, "\t")
+      k = f[1] + 0
+      nl[k]++
+      laddr[k, nl[k]] = hex(f[2]); lsrc[k, nl[k]] = f[3]
+    }
+    while ((getline l < old_src) > 0) {
+      split(l, f, "\t")
+      fname[f[1]] = f[2]
+    }
+  }
+  {
+    # "<pc> <symbol> <offset> <file:line> <new start> <new size> <old size>"
+    pc = $1; off = $3; src = $4; start = $5 + 0
+    if (!start) { how = "none"; to = "-" }
+    else if ($6 == $7) { how = "exact"; to = sprintf("0x%08x", start + off) }
+    else {
+      how = "function"; to = sprintf("0x%08x", start)
+      best = 0; dist = 0
+      for (i = 1; i <= nl[start]; i++) {
+        if (file_of(lsrc[start, i]) != file_of(src)) continue
+        d = line_of(lsrc[start, i]) - line_of(src); if (d < 0) d = -d
+        if (!best || d < dist) { best = i; dist = d }
+      }
+      if (best) {
+        how = dist ? "nearest" : "line"
+        to = sprintf("0x%08x", laddr[start, best])
+      }
+    }
+    if ("true" == rewrite) { if ("-" != to) map[pc] = to; next }
+    name = fname[pc]; if ("" == name || "??" == name) name = $2
+    printf "%s %s %-8s %s+0x%x at %s\n", pc, to, how, name, off, src
+  }
+  END {
+    if ("true" != rewrite) exit
+    while ((getline l < input) > 0) {
+      out = ""
+      while (match(l, /0x40[0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F]/)) {
+        a = tolower(substr(l, RSTART, RLENGTH))
+        out = out substr(l, 1, RSTART - 1) ((a in map) ? map[a] : substr(l, RSTART, RLENGTH))
+        l = substr(l, RSTART + RLENGTH)
+      }
+      print out l
+    }
+  }' "${tmp}/placed"
@@ -0,0 +1,143 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# A streaming serial monitor that decodes code addresses as lines arrive.
+# idf_monitor.py runs addr2line once per address, which falls behind at high
+# baud rates with DEBUG_ESP_BACKTRACELOG_SHOW output. Here, the function table,
+# and with -l the line table, are read from the .elf once at startup. Each
+# address is then a binary search in memory, and each line is printed, with
+# its decode, as soon as it is complete.
+#
+#   serial_monitor.sh [-b <baud>] [-l] <sketch.ino.elf> [<tty> | <capture file>]
+#
+# Reads from stdin when no tty or file is given.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-b <baud>] [-l] <sketch.ino.elf> [<tty> | <capture file>]
+
+  Reads from stdin when no tty or file is given. Each line with code
+  addresses is followed by "  <address>: <function>+<offset>".
+
+    -b  set the tty to <baud>, raw. Default 115200.
+    -l  add "at <file>:<line>". Loads the .elf line table at startup, which
+        takes longer for large sketches.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+
+EOF
+}
+
+baud=115200
+lines=false
+while [[ "${1:0:1}" == "-" ]]; do
+  case "${1}" in
+    -b) baud="${2}"; shift ;;
+    -l) lines=true ;;
+    *) print_help; exit 255 ;;
+  esac
+  shift
+done
+if [[ ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+input="${2:--}"
+
+functions=$(mktemp)
+linetab=$(mktemp)
+trap "rm -f $functions $linetab" EXIT
+
+# "<start> <size> <name>", ascending.
+${ESP_TOOLCHAIN_NM} -n -S -C --defined-only "${elf}" |
+  awk '$3 ~ /^[tTwW]$/ && $2 !~ /^0+$/ { s = $0; for (k = 1; k <= 3; k++) sub(/^ *[^ ]+ /, "", s); print $1, $2, s }' >$functions
+
+# "<address> <line> <file>", ascending, from the DWARF line table.
+if ${lines}; then
+  ${ESP_TOOLCHAIN_OBJDUMP} --dwarf=decodedline "${elf}" 2>/dev/null |
+    awk 'NF >= 3 && $2 ~ /^[0-9]+$/ && $3 ~ /^0x40/ { print substr($3, 3), $2, $1 }' |
+    sort -u -k1,1 >$linetab
+fi
+
+if [[ -c "${input}" ]]; then
+  stty -F "${input}" "${baud}" raw -echo || exit 1
+fi
+
+sed -u -e 's/\r$//' "${input}" |
+  awk -v functions=$functions -v linetab=$linetab '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      sub(/^0x/, "", h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    # Index of the last entry at or before a, 0 when none.
+    function floor_(tab, n, a,   lo, hi, mid) {
+      lo = 1; hi = n
+      while (lo <= hi) {
+        mid = int((lo + hi) / 2)
+        if (tab[mid] <= a) lo = mid + 1
+        else hi = mid - 1
+      }
+      return hi
+    }
+    function decode(s,   a, f, l, out) {
+      if (s in cache) return cache[s]
+      a = hex(s)
+      f = floor_(fstart, nfn, a)
+      if (f && a < fstart[f] + fsize[f]) {
+        out = sprintf("%s+0x%x", fname[f], a - fstart[f])
+        l = floor_(laddr, nl, a)
+        if (l && laddr[l] >= fstart[f]) out = out " at " lfile[l] ":" lline[l]
+      } else {
+        out = "??"
+      }
+      return cache[s] = out
+    }
+    BEGIN {
+      while ((getline line < functions) > 0) {
+        split(line, f, " ")
+        fstart[++nfn] = hex(f[1]); fsize[nfn] = hex(f[2])
+        fname[nfn] = substr(line, length(f[1]) + length(f[2]) + 3)
+      }
+      while ((getline line < linetab) > 0) {
+        split(line, f, " ")
+        laddr[++nl] = hex(f[1]); lline[nl] = f[2]; lfile[nl] = f[3]
+      }
+    }
+    {
+      print
+      s = $0
+      while (match(s, /0x40[0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F]/)) {
+        a = tolower(substr(s, RSTART, RLENGTH))
+        s = substr(s, RSTART + RLENGTH)
+        if (a in shown) continue
+        shown[a] = 1
+        printf "  %s: %s\n", a, decode(a)
+      }
+      delete shown
+      fflush()
+    }'
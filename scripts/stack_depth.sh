@@ -0,0 +1,178 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Static worst-case stack depth. Each function's frame size is decoded from
+# its prologue, the same patterns backtrace.cpp looks for: "addi/addmi a1, a1,
+# -N" or "movi aX, N" with "sub a1, a1, aX". The call graph comes from call0
+# targets, and from "j" to the start of another function, a tail call, which
+# runs on the caller's frame. The deepest path from each entry point is
+# printed, with its frames.
+#
+#   stack_depth.sh [-e <entry>]... [-t <count>] <sketch.ino.elf>
+#
+# The result is a lower bound when a path makes indirect calls (callx0), or
+# calls code outside the .elf, like the Boot ROM; those are marked with "+".
+# Recursion is reported and not followed.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-e <entry>]... [-t <count>] <sketch.ino.elf>
+
+    -e  entry point, a function name, may be repeated. Default: setup and
+        loop, which run on the 4K cont stack. Add your ISRs and callbacks,
+        which run on the system stack.
+    -t  also list the <count> functions with the deepest stack.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+
+EOF
+}
+
+entries=""
+top=0
+while [[ "${1:0:1}" == "-" ]]; do
+  case "${1}" in
+    -e) entries="${entries}${entries:+ }${2}" ;;
+    -t) top="${2}" ;;
+    *) print_help; exit 255 ;;
+  esac
+  shift 2
+done
+if [[ ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+: ${entries:=setup loop}
+
+${ESP_TOOLCHAIN_OBJDUMP} -d -C "${elf}" |
+  awk -v entries="${entries}" -v top="${top}" '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      sub(/^0x/, "", h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    function num(s) {
+      sub(/,$/, "", s)
+      if (s ~ /^-?0x/) return (s ~ /^-/) ? -hex(substr(s, 2)) : hex(s)
+      return s + 0
+    }
+    function add_edge(kind, to) {
+      if ((cur, kind, to) in seen_edge) return
+      seen_edge[cur, kind, to] = 1
+      nedge[cur]++
+      edge[cur, nedge[cur]] = to
+      ekind[cur, nedge[cur]] = kind
+    }
+    # Worst-case depth in bytes from the entry of f. Memoized; a function
+    # reached again while still on the path is recursion.
+    function depth(f,   i, t, d, best, bt, lb) {
+      if (f in memo) return memo[f]
+      if (!(f in fname)) { lower[f] = 1; return 0 }
+      if (1 == state[f]) {
+        recursive[f] = 1
+        return 0
+      }
+      state[f] = 1
+      best = frame[f]; bt = ""; lb = (f in indirect)
+      for (i = 1; i <= nedge[f]; i++) {
+        t = edge[f, i]
+        d = depth(t)
+        if (lower[t] || !(t in fname)) lb = 1
+        # A tail call reuses the caller stack, the frame is already released.
+        if ("call" == ekind[f, i]) d += frame[f]
+        if (d > best) { best = d; bt = t }
+      }
+      state[f] = 2
+      memo[f] = best; next_[f] = bt; lower[f] = lb
+      return best
+    }
+    function show(f, d,   t) {
+      printf "%s%s: %d bytes%s\n", fname[f], (f in recursive) ? " (recursive)" : "", d, lower[f] ? "+" : ""
+      for (t = f; "" != t; t = next_[t]) {
+        printf "  %6d  %s%s%s\n", frame[t], fname[t], (t in indirect) ? "  [callx0]" : "", (t in recursive) ? "  [recursive]" : ""
+      }
+    }
+    /^[0-9a-f]+ <.*>:$/ {
+      cur = hex($1)
+      s = $0; sub(/^[0-9a-f]+ </, "", s); sub(/>:$/, "", s)
+      fname[cur] = s
+      frame[cur] = 0; insns = 0; prologue = 1
+      delete movi
+      order[++nfn] = cur
+      next
+    }
+    "" != cur && /^ *[0-9a-f]+:\t/ {
+      m = $3
+      if (prologue && ++insns > 12) prologue = 0
+      if (prologue) {
+        if (m ~ /^movi/) {
+          r = $4; sub(/,$/, "", r)
+          movi[r] = num($5)
+        } else if ((m == "addi" || m == "addi.n" || m == "addmi") && $4 == "a1," && $5 == "a1," && num($6) < 0) {
+          frame[cur] -= num($6)
+        } else if (m == "sub" && $4 == "a1," && $5 == "a1," && ($6 in movi)) {
+          frame[cur] += movi[$6]
+        } else if (m ~ /^(ret|jx|call|j$)/) {
+          prologue = 0
+        }
+      }
+      if (m == "call0") {
+        add_edge("call", hex($4))
+      } else if (m == "callx0") {
+        indirect[cur] = 1
+      } else if ((m == "j" || m == "j.l") && $0 ~ /<[^+]*>$/ && hex($4) != cur) {
+        add_edge("tail", hex($4))
+      }
+    }
+    END {
+      n = split(entries, e, " ")
+      for (i = 1; i <= n; i++) {
+        found = 0
+        for (j = 1; j <= nfn; j++) {
+          f = order[j]
+          if (fname[f] == e[i] || index(fname[f], e[i] "(") == 1) {
+            show(f, depth(f))
+            found = 1
+          }
+        }
+        if (!found) printf "%s: not found\n", e[i]
+      }
+      if (top > 0) {
+        printf "\nDeepest functions:\n"
+        for (j = 1; j <= nfn; j++) d[j] = depth(order[j])
+        for (k = 1; k <= top && k <= nfn; k++) {
+          b = 0
+          for (j = 1; j <= nfn; j++) if (!(j in used) && (!b || d[j] > d[b])) b = j
+          used[b] = 1
+          printf "  %6d%s  %s\n", d[b], lower[order[b]] ? "+" : " ", fname[order[b]]
+        }
+      }
+      nr = 0
+      for (f in recursive) nr++
+      if (nr) {
+        printf "\nRecursion, not followed, through:\n"
+        for (f in recursive) printf "  %s\n", fname[f]
+      }
+    }'
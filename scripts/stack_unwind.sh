@@ -0,0 +1,269 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Offline unwind of a ">>>stack>>>" dump, from Postmortem or from the
+# BacktraceLog stack snapshot, using the .elf. The device unwinder works
+# without symbols, scanning code backward for a prologue. Here, function
+# starts come from the symbol table and each prologue is decoded from the
+# disassembly, so the frame size and the a0 save slot are known.
+#
+#   stack_unwind.sh [-p <pc>] [-s <sp>] <sketch.ino.elf> [captured serial output]
+#
+# Each frame is printed with its SP and a confidence:
+#   prologue - caller found through the decoded prologue
+#   scan     - no usable prologue, the next code address up the stack was taken
+#
+# objdump and addr2line are each run once.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm}
+: ${ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump}
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-p <pc>] [-s <sp>] <sketch.ino.elf> [captured serial output]
+
+  Reads from stdin when no capture file is given.
+
+    -p  start PC, default epc1 from the "Exception" line.
+    -s  start SP, default from the Postmortem "sp: ... offset: ..." line, or
+        the lowest dumped address.
+
+  Each "ctx:" section of a Postmortem dump is unwound separately; only the
+  first starts at the PC, the others start with a scan.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_NM=xtensa-lx106-elf-nm
+    ESP_TOOLCHAIN_OBJDUMP=xtensa-lx106-elf-objdump
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+start_pc=""
+start_sp=""
+while [[ "${1:0:1}" == "-" && "${1}" != "-" ]]; do
+  case "${1}" in
+    -p) start_pc="${2}"; shift ;;
+    -s) start_sp="${2}"; shift ;;
+    *) print_help; exit 255 ;;
+  esac
+  shift
+done
+if [[ ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+capture="${2:--}"
+
+functions=$(mktemp)
+prologues=$(mktemp)
+frames=$(mktemp)
+symbols=$(mktemp)
+trap "rm -f $functions $prologues $frames $symbols" EXIT
+
+# "<start> <size>" of each function, by address.
+${ESP_TOOLCHAIN_NM} -n -S --defined-only "${elf}" |
+  awk '$3 ~ /^[tTwW]$/ && $2 !~ /^0+$/ { print $1, $2 }' >$functions
+
+# "<function start> <frame size> <a0 slot> <address after frame setup>
+#  <address after a0 save>" from the first instructions of each function.
+# Frame setup is "addi/addmi a1, a1, -N" or "movi aX, N" then "sub a1, a1, aX".
+${ESP_TOOLCHAIN_OBJDUMP} -d "${elf}" |
+  awk '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      sub(/^0x/, "", h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    function num(s) {
+      sub(/,$/, "", s)
+      if (s ~ /^-?0x/) return (s ~ /^-/) ? -hex(substr(s, 2)) : hex(s)
+      return s + 0
+    }
+    function flush() {
+      if ("" != fn && frame > 0) printf "%s %d %d %d %d\n", fn, frame, slot, setup, saved
+      fn = ""
+    }
+    /^[0-9a-f]+ <.*>:$/ {
+      flush()
+      fn = $1; frame = 0; slot = -1; setup = 0; saved = 0; insns = 0
+      delete movi
+      next
+    }
+    "" != fn && /^ *[0-9a-f]+:\t/ {
+      if (++insns > 12) { flush(); next }
+      addr = $1; sub(/:$/, "", addr)
+      next_addr = hex(addr) + ((length($2) > 4) ? 3 : 2)
+      m = $3
+      if (m ~ /^movi/) {
+        r = $4; sub(/,$/, "", r)
+        movi[r] = num($5)
+      } else if ((m == "addi" || m == "addi.n" || m == "addmi") && $4 == "a1," && $5 == "a1," && num($6) < 0) {
+        frame -= num($6)
+        setup = next_addr
+      } else if (m == "sub" && $4 == "a1," && $5 == "a1,") {
+        r = $6
+        if (r in movi) {
+          frame += movi[r]
+          setup = next_addr
+        }
+      } else if ((m == "s32i" || m == "s32i.n") && $4 == "a0," && $5 == "a1," && slot < 0 && setup) {
+        slot = num($6)
+        saved = next_addr
+      } else if (m ~ /^(ret|jx|call|j$)/) {
+        flush()
+      }
+    }
+    END { flush() }' >$prologues
+
+sed -e 's/\r$//' "${capture}" |
+  awk -v functions=$functions -v prologues=$prologues \
+      -v start_pc="${start_pc}" -v start_sp="${start_sp}" '
+    function hex(h,   i, v) {
+      v = 0
+      h = tolower(h)
+      sub(/^0x/, "", h)
+      for (i = 1; i <= length(h); i++) v = v * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+      return v
+    }
+    # Index of the function holding addr, 0 when none. Binary search.
+    function lookup(addr,   lo, hi, mid) {
+      lo = 1; hi = nfn
+      while (lo <= hi) {
+        mid = int((lo + hi) / 2)
+        if (addr < fstart[mid]) hi = mid - 1
+        else if (addr >= fend[mid]) lo = mid + 1
+        else return mid
+      }
+      return 0
+    }
+    # A return address follows a 3 byte call in the same function.
+    function is_retaddr(w,   f) {
+      f = lookup(w)
+      return f && w - 3 >= fstart[f]
+    }
+    function emit(pc, sp, how) {
+      printf "%d 0x%08x 0x%08x %s\n", depth++, pc, sp, how
+    }
+    # Up from sp, the first word that looks like a return address.
+    function scan(sp,   a) {
+      for (a = sp; a < hi_addr; a += 4) {
+        if ((a in mem) && is_retaddr(mem[a])) {
+          found_pc = mem[a]
+          found_sp = a + 4
+          return 1
+        }
+      }
+      return 0
+    }
+    function unwind(pc, sp, have_pc,   f, s, how, lvl) {
+      depth = 0
+      printf "ctx: %s\n", ("" == ctx) ? "?" : ctx
+      how = "start"
+      if (!have_pc) {
+        if (!scan(sp)) return
+        pc = found_pc; sp = found_sp; how = "scan"
+      }
+      for (lvl = 0; lvl < 64; lvl++) {
+        emit(pc, sp, how)
+        f = lookup(pc)
+        if (!f) return
+        s = fstart[f]
+        if ((s in frame) && pc >= saved[s] && ((sp + slot[s]) in mem)) {
+          pc = mem[sp + slot[s]]
+          sp += frame[s]
+          how = "prologue"
+          if (!is_retaddr(pc)) return
+        } else {
+          # Frame not set up yet, a leaf, or no a0 save: a0 still holds the
+          # return address and it was not dumped. Skip this frame, if any.
+          if ((s in frame) && pc >= setup[s]) sp += frame[s]
+          if (!scan(sp)) return
+          pc = found_pc; sp = found_sp; how = "scan"
+        }
+        if (sp >= hi_addr) return
+      }
+    }
+    function finish() {
+      if (inside && nmem) {
+        if ("" != start_sp) sp0 = hex(start_sp)
+        else if ("" == sp0) sp0 = lo_addr
+        have = (!unwound && "" != pc0)
+        unwind(have ? hex(pc0) : 0, sp0, have)
+        unwound = 1
+      }
+      delete mem
+      nmem = 0; sp0 = ""; lo_addr = ""; hi_addr = 0
+    }
+    BEGIN {
+      while ((getline line < functions) > 0) {
+        split(line, f, " ")
+        fstart[++nfn] = hex(f[1])
+        fend[nfn] = fstart[nfn] + hex(f[2])
+      }
+      while ((getline line < prologues) > 0) {
+        split(line, f, " ")
+        s = hex(f[1])
+        frame[s] = f[2] + 0; slot[s] = f[3] + 0; setup[s] = f[4] + 0; saved[s] = f[5] + 0
+      }
+      pc0 = start_pc
+    }
+    /epc1=0x/ && "" == start_pc && "" == pc0 {
+      s = $0; sub(/.*epc1=/, "", s); sub(/[^0-9a-fA-Fx].*$/, "", s)
+      pc0 = s
+    }
+    />>>stack>>>/ { inside = 1; next }
+    /<<<stack<<</ { finish(); inside = 0; ctx = ""; next }
+    !inside { next }
+    /^ctx:/ { finish(); ctx = $2; next }
+    /^sp: / {
+      # "sp: 3ffffd90 end: 3fffffc0 offset: 0190"
+      sp0 = hex($2) + hex($6)
+      next
+    }
+    /^ *[0-9a-fA-F]+: / {
+      a = $1; sub(/:$/, "", a)
+      a = hex(a)
+      for (i = 2; i <= NF && $i ~ /^[0-9a-fA-F]+$/; i++) {
+        mem[a] = hex($i)
+        if ("" == lo_addr || a < lo_addr) lo_addr = a
+        if (a + 4 > hi_addr) hi_addr = a + 4
+        nmem++
+        a += 4
+      }
+    }
+    END { finish() }' >$frames
+
+awk '$1 ~ /^[0-9]+$/ { print $2 }' $frames | sort -u |
+  ${ESP_TOOLCHAIN_ADDR2LINE} -afC -e "${elf}" |
+  paste - - - >$symbols
+
+awk -v symbols=$symbols '
+  BEGIN {
+    while ((getline line < symbols) > 0) {
+      split(line, f, "\t")
+      name[f[1]] = f[2] " at " f[3]
+    }
+  }
+  /^ctx:/ { print; next }
+  { printf "  #%-2d %s  sp %s  %-8s  %s\n", $1, $2, $3, $4, ($2 in name) ? name[$2] : "??" }' $frames
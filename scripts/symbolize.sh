@@ -0,0 +1,166 @@
+#!/bin/bash
+#
+#   Copyright 2022 M Hightower
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Batch symbolizer for captured serial output. Every code address in the
+# input, from any number of Backtrace lines and files, is collected,
+# de-duplicated and decoded with a single call to addr2line, inline frames
+# included. An .elf from build_index.sh is decoded from the line table stored
+# beside it instead. Each input line with addresses is then printed with its decode,
+# as text or JSON.
+#
+#   symbolize.sh [-j] <sketch.ino.elf> [captured serial output...]
+#
+# Unlike addr2line.sh, there is no dialog; it is meant for large batches of
+# field reports and for use from other scripts.
+
+namesh="${0##*/}"
+
+: ${ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line}
+
+function print_help() {
+  cat <<EOF
+
+  $namesh [-j] <sketch.ino.elf> [captured serial output...]
+
+  Reads from stdin when no capture file is given.
+
+    -j  print JSON, one object per input line with addresses.
+
+  Code addresses are 0x40000000 through 0x40ffffff. For "PC:SP" pairs, only
+  the PC is decoded.
+
+  Environment variables and assumed defaults:
+    ESP_TOOLCHAIN_ADDR2LINE=xtensa-lx106-elf-addr2line
+
+EOF
+}
+
+json=false
+if [[ "-j" == "${1}" ]]; then
+  json=true
+  shift
+fi
+if [[ "--help" == "${1}" || ! -f "${1}" ]]; then
+  print_help
+  exit 255
+fi
+elf="${1}"
+shift
+
+capture=$(mktemp)
+symbols=$(mktemp)
+trap "rm -f $capture $symbols" EXIT
+
+# Keep "<file>:<line number>:<text>" for lines with code addresses. mawk has
+# no regex intervals, the hex digits are spelled out.
+if [[ -z "${1}" ]]; then
+  set -- -
+fi
+for f in "$@"; do
+  sed -e 's/\r$//' "${f}" |
+    awk -v file="${f}" '/0x40[0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F]/ { print file ":" FNR ":" $0 }'
+done >$capture
+
+build_index="${0%/*}/build_index.sh"
+[[ -x "${build_index}" ]] || build_index=build_index.sh
+
+cut -d: -f3- $capture | grep -oE '0x40[0-9a-fA-F]{6}' | tr 'A-F' 'a-f' | sort -u |
+  if [[ -f "${elf%/*}/lines.tsv" ]]; then
+    ${build_index} addr2line -i "${elf%/*}"
+  else
+    ${ESP_TOOLCHAIN_ADDR2LINE} -aifC -e "${elf}"
+  fi >$symbols
+
+# With -i, each address is followed by one or more function, file:line pairs,
+# innermost inline frame first.
+awk -v symbols=$symbols -v json=$json '
+  function jstr(s) {
+    gsub(/\\/, "&&", s)
+    gsub(/"/, "\\\"", s)
+    gsub(/\t/, "\\t", s)
+    return "\"" s "\""
+  }
+  BEGIN {
+    addr = ""
+    while ((getline line < symbols) > 0) {
+      if (line ~ /^0x[0-9a-f]+$/) {
+        # addr2line pads to the address width of the target, 8 on the lx106
+        addr = "0x" substr(line, length(line) - 7)
+        n[addr] = 0
+        half = 0
+        continue
+      }
+      if ("" == addr) continue
+      if (0 == half) {
+        fn = line
+        half = 1
+      } else {
+        k = ++n[addr]
+        func_[addr, k] = fn
+        src[addr, k] = line
+        half = 0
+      }
+    }
+  }
+  {
+    # "<file>:<line number>:<text>", the file name may not contain a colon.
+    file = $0; sub(/:.*$/, "", file)
+    rest = substr($0, length(file) + 2)
+    lnum = rest; sub(/:.*$/, "", lnum)
+    text = substr(rest, length(lnum) + 2)
+
+    s = text
+    count = 0
+    while (match(s, /0x40[0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F][0-9a-fA-F]/)) {
+      pcs[++count] = tolower(substr(s, RSTART, RLENGTH))
+      s = substr(s, RSTART + RLENGTH)
+    }
+
+    if ("true" == json) {
+      printf "%s{\"file\":%s,\"line\":%d,\"text\":%s,\"frames\":[", (NR > 1) ? ",\n" : "[\n", jstr(file), lnum, jstr(text)
+      for (i = 1; i <= count; i++) {
+        a = pcs[i]
+        printf "%s{\"addr\":\"%s\",\"inline\":[", (i > 1) ? "," : "", a
+        for (k = 1; k <= n[a]; k++) {
+          fl = src[a, k]
+          ln = fl; sub(/^.*:/, "", ln); sub(/[^0-9].*$/, "", ln)
+          sub(/:[^:]*$/, "", fl)
+          printf "%s{\"function\":%s,\"file\":%s,\"line\":%d}", (k > 1) ? "," : "", jstr(func_[a, k]), jstr(fl), ln + 0
+        }
+        printf "]}"
+      }
+      printf "]}"
+    } else {
+      print file ":" lnum ": " text
+      for (i = 1; i <= count; i++) {
+        a = pcs[i]
+        if (0 == n[a]) {
+          printf "  %s: ??\n", a
+          continue
+        }
+        for (k = 1; k <= n[a]; k++) {
+          if (1 == k) {
+            printf "  %s: %s at %s\n", a, func_[a, k], src[a, k]
+          } else {
+            printf "  %10s (inlined by) %s at %s\n", "", func_[a, k], src[a, k]
+          }
+        }
+      }
+    }
+  }
+  END {
+    if ("true" == json) print (NR ? "\n]" : "[]")
+  }' $capture
@@ -0,0 +1,327 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+  Allocation call-site tracker.
+
+  The linker's --wrap option sends calls to malloc, calloc, realloc and free
+  to the __wrap_ versions here. These call the __real_ versions, then update
+  two tables:
+
+  * Live allocations, keyed by pointer, open addressed with linear probing.
+    Entries hold the size and the call site index.
+  * Call sites, keyed by a short backtrace taken in the wrapper. Entries hold
+    the live bytes and count, and the total number of allocations.
+
+  Call sites are never removed, a site that goes back to 0 live bytes is still
+  of interest. When either table is full, the allocation is counted as
+  untracked.
+
+  Only calls from code built with the linker options are seen. newlib internal
+  calls to _malloc_r and the SDK's pvPortMalloc are not wrapped.
+
+  Like umm_malloc, the wrappers may be called from an ISR or with the flash
+  cache off. They, the table helpers, and the unwinder are in IRAM.
+*/
+#include <Arduino.h>
+#include "backtrace.h"
+#include "BacktraceAlloc.h"
+
+#if (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
+
+#if !defined(BACKTRACE_IN_IRAM) || !BACKTRACE_IN_IRAM
+#error "DEBUG_ESP_BACKTRACELOG_ALLOC requires -DBACKTRACE_IN_IRAM=1, allocations may be made from an ISR"
+#endif
+#if (DEBUG_ESP_BACKTRACELOG_ALLOC & (DEBUG_ESP_BACKTRACELOG_ALLOC - 1))
+#error "DEBUG_ESP_BACKTRACELOG_ALLOC must be a power of 2"
+#endif
+#if (DEBUG_ESP_BACKTRACELOG_ALLOC_SITES & (DEBUG_ESP_BACKTRACELOG_ALLOC_SITES - 1))
+#error "DEBUG_ESP_BACKTRACELOG_ALLOC_SITES must be a power of 2"
+#endif
+#if (DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH < 2) || (DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH > 4)
+#error "DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH must be 2 to 4"
+#endif
+
+constexpr size_t alloc_live_sz = DEBUG_ESP_BACKTRACELOG_ALLOC;
+constexpr size_t alloc_live_limit = alloc_live_sz - alloc_live_sz / 4u; // Keep probe runs short
+constexpr size_t alloc_site_sz = DEBUG_ESP_BACKTRACELOG_ALLOC_SITES;
+constexpr size_t alloc_site_probe = 8;
+constexpr size_t alloc_depth = DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH;
+constexpr uint32_t alloc_sample = DEBUG_ESP_BACKTRACELOG_ALLOC_SAMPLE;
+constexpr size_t alloc_report_max = 16;
+
+struct AllocLive {
+    void *ptr;
+    uint32_t size;
+    uint32_t site;
+};
+
+struct AllocSite {
+    const void *pc[alloc_depth];  // Innermost first, pc[0] == NULL for unused
+    uint32_t liveBytes;
+    uint32_t liveCount;
+    uint32_t allocs;
+};
+
+static struct AllocLive alloc_live[alloc_live_sz];
+static struct AllocSite alloc_site[alloc_site_sz];
+static size_t alloc_live_count;
+static uint32_t alloc_untracked;
+static uint32_t alloc_sample_count;
+
+extern "C" {
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void __wrap_free(void *ptr);
+
+static inline __attribute__((always_inline)) size_t alloc_live_hash(const void *ptr) {
+    uintptr_t p = (uintptr_t)ptr;
+    return ((p >> 3) ^ (p >> 13)) & (alloc_live_sz - 1u);
+}
+
+/*
+  Backtrace from the wrapper's caller. Always inline, the only frame between
+  the unwinder start and the caller must be the wrapper's.
+*/
+static inline __attribute__((always_inline)) void alloc_signature(const void **sig, const void *lr) {
+    const void *pc, *sp, *fn;
+    __asm__ __volatile__(
+      "mov  %[sp], a1\n\t"
+      "movi %[pc], .\n\t"
+      : [pc]"=r"(pc), [sp]"=r"(sp)
+      :
+      : "memory");
+    size_t n = 0;
+    while (n < alloc_depth &&
+           xt_retaddr_callee_ex(pc, sp, lr, &pc, &sp, &fn)) {
+        sig[n++] = pc;
+        lr = NULL;
+    }
+    for (; n < alloc_depth; n++) {
+        sig[n] = NULL;
+    }
+}
+
+static IRAM_ATTR bool alloc_sampled(void) {
+    if (1u >= alloc_sample) return true;
+
+    uint32_t saved_ps = xt_rsil(15);
+    bool sampled = (0 == alloc_sample_count);
+    if (++alloc_sample_count >= alloc_sample) {
+        alloc_sample_count = 0;
+    }
+    xt_wsr_ps(saved_ps);
+    return sampled;
+}
+
+// Called with interrupts off
+static IRAM_ATTR size_t alloc_site_find(const void * const *sig) {
+    uint32_t hash = 0;
+    for (size_t i = 0; i < alloc_depth; i++) {
+        hash = hash * 31u + (uint32_t)sig[i];
+    }
+    hash ^= hash >> 16;
+    size_t idx = hash & (alloc_site_sz - 1u);
+    for (size_t probe = 0; probe < alloc_site_probe; probe++) {
+        struct AllocSite *s = &alloc_site[idx];
+        if (NULL == s->pc[0]) {
+            for (size_t i = 0; i < alloc_depth; i++) {
+                s->pc[i] = sig[i];
+            }
+            return idx;
+        }
+        size_t i = 0;
+        while (i < alloc_depth && s->pc[i] == sig[i]) i++;
+        if (alloc_depth == i) {
+            return idx;
+        }
+        idx = (idx + 1u) & (alloc_site_sz - 1u);
+    }
+    return SIZE_MAX;
+}
+
+static IRAM_ATTR void alloc_track(void *ptr, size_t size, const void * const *sig) {
+    uint32_t saved_ps = xt_rsil(15);
+    size_t site = SIZE_MAX;
+    if (alloc_live_count < alloc_live_limit && NULL != sig[0]) {
+        site = alloc_site_find(sig);
+    }
+    if (SIZE_MAX == site) {
+        alloc_untracked++;
+    } else {
+        size_t idx = alloc_live_hash(ptr);
+        while (alloc_live[idx].ptr) {
+            idx = (idx + 1u) & (alloc_live_sz - 1u);
+        }
+        alloc_live[idx].ptr = ptr;
+        alloc_live[idx].size = size;
+        alloc_live[idx].site = site;
+        alloc_live_count++;
+        alloc_site[site].liveBytes += size;
+        alloc_site[site].liveCount++;
+        alloc_site[site].allocs++;
+    }
+    xt_wsr_ps(saved_ps);
+}
+
+/*
+  Remove with backward shift, no tombstones. An entry after the hole moves
+  into it unless its home slot is cyclically within (hole, entry].
+*/
+static IRAM_ATTR void alloc_untrack(void *ptr) {
+    if (NULL == ptr) return;
+
+    uint32_t saved_ps = xt_rsil(15);
+    size_t i = alloc_live_hash(ptr);
+    while (alloc_live[i].ptr && ptr != alloc_live[i].ptr) {
+        i = (i + 1u) & (alloc_live_sz - 1u);
+    }
+    if (ptr == alloc_live[i].ptr) {
+        struct AllocSite *s = &alloc_site[alloc_live[i].site];
+        s->liveBytes -= alloc_live[i].size;
+        s->liveCount--;
+        alloc_live_count--;
+
+        size_t j = i;
+        while (true) {
+            j = (j + 1u) & (alloc_live_sz - 1u);
+            if (NULL == alloc_live[j].ptr) break;
+            size_t k = alloc_live_hash(alloc_live[j].ptr);
+            if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+            alloc_live[i] = alloc_live[j];
+            i = j;
+        }
+        alloc_live[i].ptr = NULL;
+    }
+    xt_wsr_ps(saved_ps);
+}
+
+IRAM_ATTR void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if (ptr && alloc_sampled()) {
+        const void *sig[alloc_depth];
+        alloc_signature(sig, __builtin_return_address(0));
+        alloc_track(ptr, size, sig);
+    }
+    return ptr;
+}
+
+IRAM_ATTR void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    if (ptr && alloc_sampled()) {
+        const void *sig[alloc_depth];
+        alloc_signature(sig, __builtin_return_address(0));
+        alloc_track(ptr, count * size, sig);
+    }
+    return ptr;
+}
+
+/*
+  A moved or resized block is charged to the realloc call site. On failure
+  the old block is still live and keeps its entry.
+*/
+IRAM_ATTR void *__wrap_realloc(void *ptr, size_t size) {
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr || 0 == size) {
+        alloc_untrack(ptr);
+    }
+    if (new_ptr && alloc_sampled()) {
+        const void *sig[alloc_depth];
+        alloc_signature(sig, __builtin_return_address(0));
+        alloc_track(new_ptr, size, sig);
+    }
+    return new_ptr;
+}
+
+IRAM_ATTR void __wrap_free(void *ptr) {
+    alloc_untrack(ptr);
+    __real_free(ptr);
+}
+
+void backtraceLog_alloc_clear(void) {
+    uint32_t saved_ps = xt_rsil(15);
+    memset(alloc_live, 0, sizeof(alloc_live));
+    memset(alloc_site, 0, sizeof(alloc_site));
+    alloc_live_count = 0;
+    alloc_untracked = 0;
+    alloc_sample_count = 0;
+    xt_wsr_ps(saved_ps);
+}
+
+/*
+  Fill top[] with site indexes, most live bytes first. Returns the number found.
+  Reads without locking, a report is a snapshot and may be slightly off.
+*/
+static size_t alloc_top_sites(size_t *top, size_t max) {
+    size_t n = 0;
+    for (size_t idx = 0; idx < alloc_site_sz; idx++) {
+        if (NULL == alloc_site[idx].pc[0] || 0 == alloc_site[idx].liveBytes) continue;
+
+        uint32_t bytes = alloc_site[idx].liveBytes;
+        size_t i = (n < max) ? n++ : max;
+        while (i > 0 && bytes > alloc_site[top[i - 1u]].liveBytes) {
+            if (i < max) top[i] = top[i - 1u];
+            i--;
+        }
+        if (i < max) top[i] = idx;
+    }
+    return n;
+}
+
+void backtraceLog_alloc_ets_report(int (*ets_printf_P)(const char *fmt, ...), size_t top) {
+    size_t idx[alloc_report_max];
+    if (top > alloc_report_max) top = alloc_report_max;
+
+    ets_printf_P(PSTR("Alloc tracked: %u blocks, untracked: %u, sample: 1/%u\r\n"),
+        alloc_live_count, alloc_untracked, alloc_sample);
+    size_t n = alloc_top_sites(idx, top);
+    for (size_t i = 0; i < n; i++) {
+        const struct AllocSite *s = &alloc_site[idx[i]];
+        ets_printf_P(PSTR("Alloc: %u %u %u"), s->liveBytes, s->liveCount, s->allocs);
+        for (size_t j = 0; j < alloc_depth && s->pc[j]; j++) {
+            ets_printf_P(PSTR(" %p"), s->pc[j]);
+        }
+        ets_printf_P(PSTR("\r\n"));
+    }
+}
+
+}; // extern "C" {
+
+void backtraceLog_alloc_report(Print& out, size_t top) {
+    size_t idx[alloc_report_max];
+    if (top > alloc_report_max) top = alloc_report_max;
+
+    out.printf_P(PSTR("Alloc tracked: %u blocks, untracked: %u, sample: 1/%u\r\n"),
+        alloc_live_count, alloc_untracked, alloc_sample);
+    size_t n = alloc_top_sites(idx, top);
+    for (size_t i = 0; i < n; i++) {
+        const struct AllocSite *s = &alloc_site[idx[i]];
+        out.printf_P(PSTR("Alloc: %u %u %u"), s->liveBytes, s->liveCount, s->allocs);
+        for (size_t j = 0; j < alloc_depth && s->pc[j]; j++) {
+            out.printf_P(PSTR(" %p"), s->pc[j]);
+        }
+        out.printf_P(PSTR("\r\n"));
+    }
+}
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
@@ -0,0 +1,83 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACEALLOC_H
+#define _BACKTRACEALLOC_H
+
+#include <Arduino.h>
+
+/*
+  Allocation call-site tracker. malloc, calloc, realloc and free are wrapped.
+  Each sampled allocation is tagged with a short backtrace, its call site.
+  Live bytes and counts are totaled per call site, the sites holding the most
+  memory are the leak suspects.
+
+  The wrappers are linked in with these linker options, add them to
+  `compiler.c.elf.extra_flags=` in `platform.local.txt`:
+    -Wl,--wrap=malloc -Wl,--wrap=free -Wl,--wrap=realloc -Wl,--wrap=calloc
+
+  DEBUG_ESP_BACKTRACELOG_ALLOC - number of live allocations that can be
+  tracked, 0 disables. Must be a power of 2. 12 bytes each.
+
+  DEBUG_ESP_BACKTRACELOG_ALLOC_SITES - number of call sites, must be a power of
+  2. 4 * (3 + DEPTH) bytes each.
+
+  DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH - backtrace levels that make up a call
+  site, 2 to 4.
+
+  DEBUG_ESP_BACKTRACELOG_ALLOC_SAMPLE - track 1 in N allocations. 1 tracks all.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_ALLOC
+#define DEBUG_ESP_BACKTRACELOG_ALLOC 0
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_ALLOC_SITES
+#define DEBUG_ESP_BACKTRACELOG_ALLOC_SITES 32
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH
+#define DEBUG_ESP_BACKTRACELOG_ALLOC_DEPTH 3
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_ALLOC_SAMPLE
+#define DEBUG_ESP_BACKTRACELOG_ALLOC_SAMPLE 1
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
+
+/*
+  Print the top call sites by live bytes. One "Alloc:" line per site, live
+  bytes, live count, total allocations, then the backtrace, innermost first.
+*/
+void backtraceLog_alloc_report(Print& out=Serial, size_t top=8);
+
+// Same, for use from the crash callback, when Print is not safe to use.
+extern "C" void backtraceLog_alloc_ets_report(int (*ets_printf_P)(const char *fmt, ...), size_t top);
+
+// Forget all tracked allocations and call sites.
+extern "C" void backtraceLog_alloc_clear(void);
+
+#else // #if (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
+
+static inline __attribute__((always_inline))
+void backtraceLog_alloc_report(Print& out=Serial, size_t top=8) { (void)out; (void)top; }
+static inline __attribute__((always_inline))
+void backtraceLog_alloc_ets_report(int (*ets_printf_P)(const char *fmt, ...), size_t top) { (void)ets_printf_P; (void)top; }
+static inline __attribute__((always_inline))
+void backtraceLog_alloc_clear(void) {}
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
+#endif // _BACKTRACEALLOC_H
@@ -0,0 +1,950 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+  Library version of the HwdtLastCall.cpp module from the HwdtBacktrace example.
+  It expands HWDT Reporting at reboot with a backtrace. Enable with
+  -DDEBUG_ESP_BACKTRACELOG_INSTRUMENT=1 and add the "-finstrument-functions"
+  lines to your `<sketch name>.ino.globals.h` file. Read further for details.
+
+  For details about the GCC command line option "-finstrument-functions" see
+  https://gcc.gnu.org/onlinedocs/gcc/Instrumentation-Options.html
+
+  This module maintains a stack of PC:stack-frame values for (most) function
+  calls made before a Hardware WDT crash. To do this we define a basic asm
+  functions that is called at each function entry.
+
+  With DEBUG_ESP_BACKTRACELOG_EVENT_RING, each function entry and exit is also
+  recorded with a CCOUNT time stamp. After a HWDT, the ring is printed as a
+  timeline, oldest first, showing the CCOUNT delta from the previous event.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST selects hand coded asm versions of the
+  enter/exit hooks, see examples/InstrumentBenchmark for the difference.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER limits tracking, at runtime, to
+  functions inside a table of address ranges. Build with broad instrumentation,
+  then enable only the code under suspicion. scripts/instrument_ranges.sh
+  creates the ranges from the .elf.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM keeps a log2 histogram of the
+  elapsed cycles of each function call. scripts/histogram_report.sh symbolizes
+  the output of backtraceLog_instrument_histogram_dump().
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK records the deepest stack use per
+  function and the call chain that reached each stack's low-water mark.
+
+  backtraceLog_instrument_backtrace() reads a backtrace straight from the PC:SP
+  stack, and with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW the postmortem crash
+  callback uses it for the user space backtrace.
+
+  The overhead is high with the "instrument-functions" option. So we do not
+  want it applied everywhere. At the same time if we limit the coverage too
+  much, we may miss the event that caused the HWDT.
+
+  You will need to tune this build option list for your sketch.
+  Add something like this to your sketch `<sketch name>.ino.globals.h` file:
+    -finstrument-functions
+    -finstrument-functions-exclude-function-list=app_entry,ets_intr_,ets_post,Cache_Read_Enable,non32xfer_exception_handler
+    -finstrument-functions-exclude-file-list=umm_malloc,hwdt_app_entry,core_esp8266_postmortem,core_esp8266_app_entry_noextra4k,mmu_iram,backtrace,BacktraceLog,StackThunk
+
+  Every function in this module is marked no_instrument_function. The library
+  folder name does not need to match the exclude list.
+*/
+#include <Arduino.h>
+#include "BacktraceInstrument.h"
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT
+#include <user_interface.h>
+#include <cont.h>
+#include "backtrace.h"
+#include "BacktraceLog.h"
+
+#if (DEBUG_ESP_BACKTRACELOG_EVENT_RING > 0) && \
+    (DEBUG_ESP_BACKTRACELOG_EVENT_RING & (DEBUG_ESP_BACKTRACELOG_EVENT_RING - 1))
+#error "DEBUG_ESP_BACKTRACELOG_EVENT_RING must be a power of 2"
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER > 0)
+#error "DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER is not supported with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST"
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0)
+#error "DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM is not supported with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST"
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0) && \
+    (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM & (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM - 1))
+#error "DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM must be a power of 2"
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0)
+#error "DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK is not supported with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST"
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0) && \
+    (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK & (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK - 1))
+#error "DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK must be a power of 2"
+#endif
+
+#define INSTRUMENT_STR2(a) #a
+#define INSTRUMENT_STR(a) INSTRUMENT_STR2(a)
+
+#ifndef NO_INSTRUMENT
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+#endif
+
+#if defined(DEBUG_ESP_HWDT) || defined(DEBUG_ESP_HWDT_NOEXTRA4K)
+#include <hwdt_app_entry.h>
+#define HWDT_REPORT 1
+// Must survive the HWDT reboot
+#define INSTRUMENT_NOINIT __attribute__((section(".noinit")))
+
+/*
+  DEBUG_ESP_HWDT_POST_REPORT_CB is not yet supported.
+  It requires a PR to Arduino ESP8266.
+*/
+#ifdef DEBUG_ESP_HWDT_POST_REPORT_CB
+#define ADD_SYS_STACK_E000_CHECK 1
+#else
+#define DEBUG_ESP_HWDT_POST_REPORT_CB hwdt_pre_sdk_init
+#define ADD_SYS_STACK_E000_CHECK 0
+#endif
+extern "C" void DEBUG_ESP_HWDT_POST_REPORT_CB(void) NO_INSTRUMENT;
+
+#else
+#define HWDT_REPORT 0
+#define INSTRUMENT_NOINIT
+#endif
+
+#define SYS_STACK_E000     ((uint32_t *)0x3fffe000UL)
+#ifndef CONT_STACKGUARD
+#define CONT_STACKGUARD 0xfeefeffe
+#endif
+
+#if ADD_SYS_STACK_E000_CHECK
+#define RTC_SYS         ((volatile uint32_t*)0x60001100UL)
+extern "C" void ets_wdt_enable(void);
+static bool bypass __attribute__((section(".noinit")));
+#endif
+
+extern "C" {
+
+  #define INSTRUMENT_STACK_SZ 48
+  constexpr ssize_t stack_sz = INSTRUMENT_STACK_SZ;
+
+  // Used when hwdt_pre_sdk_init() is called to find a reasonable starting point
+  // for backtracing.
+  struct LastPCPS {
+    void *pc;
+    void *sp;
+  };
+  struct StackLastPCPS {
+    ssize_t level;
+    struct LastPCPS last[stack_sz];
+  } hwdt_last_call
+  INSTRUMENT_NOINIT; // Inialized by hwdt_pre_sdk_init();
+
+  static inline __attribute__((always_inline))
+  uint32_t instrument_ccount(void) {
+    return esp_get_cycle_count();
+  }
+
+#if (DEBUG_ESP_BACKTRACELOG_EVENT_RING > 0)
+  constexpr uint32_t event_ring_sz = DEBUG_ESP_BACKTRACELOG_EVENT_RING;
+
+  /*
+    Function addresses are at least 4 byte aligned. Bit 0 of fn marks an exit
+    event.
+  */
+  struct HwdtEvent {
+    uint32_t fn;
+    uint32_t ccount;
+  };
+  struct HwdtEventRing {
+    uint32_t head;      // Total events recorded, index is head % event_ring_sz
+    struct HwdtEvent event[event_ring_sz];
+  } hwdt_event_ring
+  INSTRUMENT_NOINIT; // Inialized by hwdt_pre_sdk_init();
+
+  static inline __attribute__((always_inline))
+  void hwdt_event_record(void *this_fn, uint32_t exit) {
+    uint32_t ccount = instrument_ccount();
+    uint32_t idx = hwdt_event_ring.head++ & (event_ring_sz - 1u);
+    hwdt_event_ring.event[idx].fn = (uint32_t)(uintptr_t)this_fn | exit;
+    hwdt_event_ring.event[idx].ccount = ccount;
+  }
+#else
+  static inline __attribute__((always_inline))
+  void hwdt_event_record(void *this_fn, uint32_t exit) { (void)this_fn; (void)exit; }
+#endif
+
+#if HWDT_REPORT
+  ////////////////////////////////////////////////////////////////////////////////
+  // Code to run at reboot of a HWDT before SDK init
+  //
+  /*
+    Printing from hwdt_pre_sdk_init() requires special considerations. Normal
+    "C" runtime initialization has not run at the time it is called. For
+    printing from this context, we use umm_info_safe_printf_P. It is capable of
+    handling this situation, it supports PROGMEM strings, and is a function
+    included in umm_malloc.  ets_uart_printf would also work; however, it does
+    not support PROGMEM strings.
+  */
+  extern int umm_info_safe_printf_P(const char *fmt, ...);
+  #define ETS_PRINTF_P(fmt, ...) umm_info_safe_printf_P(fmt, ##__VA_ARGS__)
+  #define ETS_PRINTF(fmt, ...) ETS_PRINTF_P(PSTR(fmt), ##__VA_ARGS__)
+#ifdef DEBUG_BACKTRACEINSTRUMENT_CPP
+  #define ETS_PRINTF2(fmt, ...) ETS_PRINTF_P(PSTR(fmt), ##__VA_ARGS__)
+#else
+  #define ETS_PRINTF2(fmt, ...)
+#endif
+
+#if ADD_SYS_STACK_E000_CHECK
+/*
+ *  Fill the SDK stack area with CONT_STACKGUARD so we can detect used space
+ *  and overflow.
+ */
+static size_t NO_INSTRUMENT paint_sys_stack(void) {
+    // size_t this_mutch = (uintptr_t)ROM_STACK - (uintptr_t)SYS_STACK;
+    size_t this_mutch;
+    asm volatile("mov %[sp], a1\n\t":[sp]"=r"(this_mutch)::"memory");
+    this_mutch -= (uintptr_t)SYS_STACK_E000;
+    this_mutch /= sizeof(uint32_t);
+    for (size_t i = 0; i < this_mutch; i++) {
+        SYS_STACK_E000[i] = CONT_STACKGUARD;
+    }
+    return this_mutch * sizeof(uint32_t);
+}
+
+static size_t NO_INSTRUMENT check_paint_sys_stack(void) {
+    size_t this_mutch;
+    asm volatile("mov %[sp], a1\n\t":[sp]"=r"(this_mutch)::"memory");
+    this_mutch -= (uintptr_t)SYS_STACK_E000;
+    this_mutch /= sizeof(uint32_t);
+    for (size_t i = 0; i < this_mutch; i++) {
+        if (SYS_STACK_E000[i] != CONT_STACKGUARD) {
+            this_mutch = i;
+            break;
+        }
+    }
+    return this_mutch * sizeof(uint32_t);
+}
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_EVENT_RING > 0)
+  /*
+    Print the event ring, oldest first. Each line shows the CCOUNT delta from
+    the previous event, enter (>) or exit (<), and the function address.
+
+    Then add the events to the backtrace log, newest first, after a 0
+    separator. The log keeps as many as will fit. Exit events have bit 0 set.
+  */
+  static void NO_INSTRUMENT hwdt_event_report(void) {
+    uint32_t head = hwdt_event_ring.head;
+    uint32_t count = (head < event_ring_sz) ? head : event_ring_sz;
+    if (0 == count) return;
+
+    ETS_PRINTF("  Last %u function events, CCOUNT delta, oldest first:\n", count);
+    uint32_t last = hwdt_event_ring.event[(head - count) & (event_ring_sz - 1u)].ccount;
+    for (uint32_t i = head - count; i != head; i++) {
+      const struct HwdtEvent *e = &hwdt_event_ring.event[i & (event_ring_sz - 1u)];
+      ETS_PRINTF("    +%u\t%c %p\n", e->ccount - last, (e->fn & 1u) ? '<' : '>', (void*)(e->fn & ~1u));
+      last = e->ccount;
+    }
+
+    backtraceLog_write(NULL);
+    for (uint32_t i = head; i != head - count; i--) {
+      backtraceLog_write((void*)hwdt_event_ring.event[(i - 1u) & (event_ring_sz - 1u)].fn);
+    }
+  }
+#else
+  static inline __attribute__((always_inline)) void hwdt_event_report(void) {}
+#endif
+
+  /*
+    Notes:
+
+    DEBUG_ESP_HWDT_POST_REPORT_CB() is called early with the smaller zeroed out
+    part of the system stack, size ~2800 bytes. Most of the original system
+    stack is available.
+
+    hwdt_pre_sdk_init() is called later with the system stack any interesting
+    data will be overwritten.
+
+    hwdt_pre_sdk_init()/DEBUG_ESP_HWDT_POST_REPORT_CB is called from HWDT Stack
+    Dump before starting the SDK and before the Heap is available(); however, a
+    16K ICACHE is online. The UART is enabled and the Serial speed has been
+    preset.
+
+    We rely on the values of the struct StackLastPCPS hwdt_last_call and the
+    event ring set during the crash context before the reboot.
+    hwdt_pre_sdk_init() must handle zero initing the structures before
+    returning.
+
+    When we are called, the SDK has not started. The "C" runtime code that will
+    zero the structures does not run until later when the SDK calls user_init().
+
+    The reset reason was determinted by HWDT Stack Dump not the SDK. On
+    rare occations they can differ. When the SDK crashes at startup before
+    the timer tick for the Soft WDT, RTC_SYS[0] is still set to Hardware WDT and
+    falsely reported on the subsequent reboot. HWDT Stack Dump gets this case
+    right.
+  */
+  void NO_INSTRUMENT DEBUG_ESP_HWDT_POST_REPORT_CB(void) {
+#if ADD_SYS_STACK_E000_CHECK
+    if (REASON_DEFAULT_RST == hwdt_info.reset_reason ||
+        REASON_EXT_SYS_RST == hwdt_info.reset_reason ||
+        REASON_DEEP_SLEEP_AWAKE == hwdt_info.reset_reason) {
+        bypass = false;
+    } else if (bypass) {
+        bypass = false;
+        return;
+    }
+#endif
+
+    if (REASON_WDT_RST == hwdt_info.reset_reason) {
+      ETS_PRINTF("\n\nHWDT Backtrace Crash Report:\n");
+#if ADD_SYS_STACK_E000_CHECK
+      ssize_t stack_free = paint_sys_stack();
+      ETS_PRINTF2("  Available stack space for 'hwdt_post_processing' callback: %u bytes.\n", stack_free);
+#endif
+      int repeat;
+      void *pc = NULL, *sp = NULL;
+      ssize_t level = hwdt_last_call.level;
+      if (stack_sz < level) {
+        ETS_PRINTF("  level(%d) exceeded PC:SP tracker stack size(%d)\n", level, stack_sz);
+        level = stack_sz; // Show what we can
+      } else if (0 > level) {
+        ETS_PRINTF("  Internal error: Bad level(%d) for PC:SP tracker stack\n", level);
+        level = -1;
+      }
+      if (stack_sz >= level && 0 <= level) {
+        ETS_PRINTF2("  Internal state: level(%d) for PC:SP tracker stack\n", level);
+        /*
+          Reach for the just released stack-frame - it provides a better
+          backtrace start point. One level back should be safe, most of the time.
+          Scan forward to be sure our current stack is in the list. If we are
+          there, there is a good chance the released stack-frame is still good.
+        */
+        pc = hwdt_last_call.last[level].pc;
+        sp = hwdt_last_call.last[level].sp;
+        if (level > 0) {
+          level--;
+          int limiter = 16;
+          do {
+            if (sp == hwdt_last_call.last[level].sp) {
+              level++;
+              break;
+            }
+            repeat = xt_retaddr_callee(pc, sp, NULL, &pc, &sp);
+          } while(repeat && --limiter);
+          pc = hwdt_last_call.last[level].pc;
+          sp = hwdt_last_call.last[level].sp;
+        }
+      }
+
+      struct rst_info reset_info;
+      memset(&reset_info, 0, sizeof(struct rst_info));
+      reset_info.reason = REASON_WDT_RST;
+      backtraceLog_begin(&reset_info);
+
+      ETS_PRINTF("  Backtrace:");
+      int limiter = 64;
+      do {
+        ETS_PRINTF(" %p:%p", pc, sp);
+        backtraceLog_write(pc);
+        repeat = xt_retaddr_callee(pc, sp, NULL, &pc, &sp);
+      } while(repeat && --limiter);
+
+      if (g_pcont->pc_suspend) {
+          // Looks like we crashed while the Sketch was yielding.
+          // Finish traceback on the cont (loop_wrapper) stack.
+          ETS_PRINTF(" 0:0");  // mark transistion
+          backtraceLog_write(NULL);
+          // Extract resume context to traceback - see cont_continue in cont.S
+          sp = (void*)((uintptr_t)g_pcont->sp_suspend + 24u);
+          pc = *(void**)((uintptr_t)g_pcont->sp_suspend + 16u);
+          do {
+              ETS_PRINTF(" %p:%p", pc, sp);
+              backtraceLog_write(pc);
+              repeat = xt_retaddr_callee(pc, sp, NULL, &pc, &sp);
+          } while(repeat);
+      }
+      ETS_PRINTF("\n");
+      hwdt_event_report();
+      backtraceLog_fin();
+      ETS_PRINTF("\n");
+
+#if ADD_SYS_STACK_E000_CHECK
+      stack_free -= check_paint_sys_stack();
+      ETS_PRINTF2("  Stack space used: %d bytes.\n", stack_free);
+      if (0 < stack_free) {
+          ETS_PRINTF("  Stack overflow during 'hwdt_post_processing' callback.\n");
+          // TODO add code to reboot and not run hwdt_post_processing
+          // Yikes, how do I do a clean restart from here??
+          // Not great; however, at least it doesn't loop forever.
+          RTC_SYS[0] = 0;
+          bypass = true;
+          ets_wdt_enable();
+          while(true);
+      }
+#endif
+    }
+
+    // We must handle structure initialization here
+    ets_memset(&hwdt_last_call, 0, sizeof(hwdt_last_call));
+#if (DEBUG_ESP_BACKTRACELOG_EVENT_RING > 0)
+    ets_memset(&hwdt_event_ring, 0, sizeof(hwdt_event_ring));
+#endif
+#if ADD_SYS_STACK_E000_CHECK
+    bypass = false;
+#endif
+  }
+#endif // #if HWDT_REPORT
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Shadow stack backtrace, from hwdt_last_call.
+  //
+  // Untracked functions, excluded from instrumentation, may sit between two
+  // levels. Allow the unwinder a few steps to reach the level below.
+  //
+  constexpr size_t shadow_check_steps = 4;
+
+  size_t NO_INSTRUMENT backtraceLog_instrument_backtrace(const void **pc, size_t max, size_t *mismatch) {
+    return backtraceLog_instrument_backtrace_ex(pc, NULL, max, mismatch);
+  }
+
+  size_t NO_INSTRUMENT backtraceLog_instrument_backtrace_ex(const void **pc, const void **sp, size_t max, size_t *mismatch) {
+    ssize_t level = hwdt_last_call.level;
+    if (level > stack_sz) {
+      level = stack_sz;
+    } else if (level < 0) {
+      level = 0;
+    }
+
+    size_t n = 0;
+    size_t bad = 0;
+    for (ssize_t i = level - 1; i >= 0 && n < max; i--) {
+      const void *i_pc = hwdt_last_call.last[i].pc;
+      const void *i_sp = hwdt_last_call.last[i].sp;
+      if (sp) {
+        sp[n] = i_sp;
+      }
+      pc[n++] = i_pc;
+      if (mismatch && i > 0) {
+        const void *caller_sp = hwdt_last_call.last[i - 1].sp;
+        const void *fn;
+        size_t step = 0;
+        while (step < shadow_check_steps && i_sp != caller_sp &&
+               xt_retaddr_callee_ex(i_pc, i_sp, NULL, &i_pc, &i_sp, &fn)) {
+          step++;
+        }
+        if (i_sp != caller_sp) {
+          bad++;
+        }
+      }
+    }
+    if (mismatch) {
+      *mismatch = bad;
+    }
+    return n;
+  }
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER > 0)
+  ////////////////////////////////////////////////////////////////////////////////
+  // Runtime filter, only functions with an entry point inside one of the
+  // address ranges are tracked. An empty table tracks everything.
+  //
+  // Ranges are kept sorted and merged, [start, end).
+  //
+  constexpr size_t filter_sz = DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER;
+
+  struct InstrumentRange {
+    uintptr_t start;
+    uintptr_t end;
+  };
+  static struct InstrumentRange filter_range[filter_sz];
+  static size_t filter_count;
+
+  static inline __attribute__((always_inline))
+  bool instrument_filter_match(void *this_fn) {
+    size_t hi = filter_count;
+    if (0 == hi) return true;
+
+    uintptr_t fn = (uintptr_t)this_fn;
+    size_t lo = 0;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2u;
+      if (fn < filter_range[mid].start) {
+        hi = mid;
+      } else if (fn >= filter_range[mid].end) {
+        lo = mid + 1u;
+      } else {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool NO_INSTRUMENT backtraceLog_instrument_filter_add(const void *start, const void *end) {
+    uintptr_t s = (uintptr_t)start;
+    uintptr_t e = (uintptr_t)end;
+    if (s >= e) return false;
+
+    // The hooks may run from an ISR, keep them from seeing a partial update.
+    uint32_t saved_ps = xt_rsil(15);
+    size_t i = 0;
+    while (i < filter_count && filter_range[i].end < s) i++;
+    // Fold in every range that overlaps or touches the new one.
+    size_t j = i;
+    while (j < filter_count && filter_range[j].start <= e) {
+      if (filter_range[j].start < s) s = filter_range[j].start;
+      if (filter_range[j].end > e) e = filter_range[j].end;
+      j++;
+    }
+    if (i == j) {
+      if (filter_count >= filter_sz) {
+        xt_wsr_ps(saved_ps);
+        return false;
+      }
+      memmove(&filter_range[i + 1u], &filter_range[i], (filter_count - i) * sizeof(filter_range[0]));
+      filter_count++;
+    } else if (j - i > 1u) {
+      memmove(&filter_range[i + 1u], &filter_range[j], (filter_count - j) * sizeof(filter_range[0]));
+      filter_count -= j - i - 1u;
+    }
+    filter_range[i].start = s;
+    filter_range[i].end = e;
+    xt_wsr_ps(saved_ps);
+    return true;
+  }
+
+  void NO_INSTRUMENT backtraceLog_instrument_filter_clear(void) {
+    filter_count = 0;
+  }
+#else
+  static inline __attribute__((always_inline))
+  bool instrument_filter_match(void *this_fn) { (void)this_fn; return true; }
+#endif // #if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER > 0)
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0)
+  ////////////////////////////////////////////////////////////////////////////////
+  // Per function latency histograms. Enter saves CCOUNT next to the PC:SP
+  // shadow stack entry, exit adds the elapsed cycles to the function's log2
+  // histogram. Times are inclusive of callees, interrupts and, for the cont
+  // stack, time spent yielding.
+  //
+  constexpr size_t histogram_sz = DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM;
+  constexpr size_t histogram_probe = 8;       // Limit time spent in the hook
+  constexpr size_t histogram_buckets = 24;    // Last bucket, >= 2^22 cycles, ~52ms
+
+  struct InstrumentHistogram {
+    uint32_t fn;
+    uint16_t count[histogram_buckets];  // Saturates at 0xFFFF
+  };
+  static struct InstrumentHistogram histogram_table[histogram_sz];
+  static uint32_t histogram_enter_ccount[stack_sz];
+  static uint32_t histogram_dropped;  // Table full
+
+  static inline __attribute__((always_inline))
+  void instrument_histogram_enter(ssize_t level) {
+    if (stack_sz > level && 0 <= level) {
+      histogram_enter_ccount[level] = instrument_ccount();
+    }
+  }
+
+  /*
+    Bucket b holds elapsed cycles in [2^(b-1), 2^b). Avoid __clzsi2 it is in
+    flash, the hooks must be safe to call from an ISR.
+  */
+  static inline __attribute__((always_inline))
+  size_t instrument_histogram_bucket(uint32_t cycles) {
+    size_t b = 0;
+    if (cycles >> 16) { b += 16; cycles >>= 16; }
+    if (cycles >> 8)  { b += 8;  cycles >>= 8; }
+    if (cycles >> 4)  { b += 4;  cycles >>= 4; }
+    if (cycles >> 2)  { b += 2;  cycles >>= 2; }
+    if (cycles >> 1)  { b += 1;  cycles >>= 1; }
+    b += cycles;
+    return (b < histogram_buckets) ? b : histogram_buckets - 1u;
+  }
+
+  static inline __attribute__((always_inline))
+  void instrument_histogram_exit(void *this_fn, ssize_t level) {
+    if (stack_sz <= level || 0 > level) return;
+
+    uint32_t cycles = instrument_ccount() - histogram_enter_ccount[level];
+    size_t b = instrument_histogram_bucket(cycles);
+    uint32_t fn = (uint32_t)(uintptr_t)this_fn;
+    uint32_t hash = fn ^ (fn >> 9);
+    size_t idx = hash & (histogram_sz - 1u);
+    for (size_t probe = 0; probe < histogram_probe; probe++) {
+      struct InstrumentHistogram *e = &histogram_table[idx];
+      if (0 == e->fn) {
+        // Claim the slot, an interrupt may have beat us to it.
+        uint32_t saved_ps = xt_rsil(15);
+        if (0 == e->fn) {
+          e->fn = fn;
+        }
+        xt_wsr_ps(saved_ps);
+      }
+      if (fn == e->fn) {
+        if (0xFFFFu != e->count[b]) {
+          e->count[b]++;
+        }
+        return;
+      }
+      idx = (idx + 1u) & (histogram_sz - 1u);
+    }
+    histogram_dropped++;
+  }
+
+  void NO_INSTRUMENT backtraceLog_instrument_histogram_clear(void) {
+    uint32_t saved_ps = xt_rsil(15);
+    memset(histogram_table, 0, sizeof(histogram_table));
+    histogram_dropped = 0;
+    xt_wsr_ps(saved_ps);
+  }
+#else
+  static inline __attribute__((always_inline))
+  void instrument_histogram_enter(ssize_t level) { (void)level; }
+  static inline __attribute__((always_inline))
+  void instrument_histogram_exit(void *this_fn, ssize_t level) { (void)this_fn; (void)level; }
+#endif // #if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0)
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0)
+  ////////////////////////////////////////////////////////////////////////////////
+  // Stack high-water tracking. At each enter, the SP of the instrumented
+  // function's frame is compared against the deepest seen for that function
+  // and for the stack it is running on. When a stack reaches a new low-water
+  // mark, the PC list from the tracking stack is saved as the call chain that
+  // got there. Deeper than the tracking stack, the function's own PC leads the
+  // chain and the untracked levels between it and the tracked ones are counted.
+  //
+  // Kept in noinit, the results survive a crash or restart. Nothing clears
+  // them at power-on; the table is only used when its magic word matches, and
+  // leftover noinit contents are relied on not to match. Otherwise it is
+  // cleared on first use.
+  //
+  constexpr size_t stack_fn_sz = DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK;
+  constexpr size_t stack_fn_probe = 8;
+  constexpr size_t stack_chain_sz = 16;
+  constexpr uint32_t stack_magic = 0x5754524cu;
+  constexpr uintptr_t sys_stack_end = 0x40000000u; // End of DRAM
+
+  struct InstrumentStackLow {
+    uint32_t depth;     // Bytes from the top of the stack to SP
+    uint32_t count;     // Entries in pc[]
+    uint32_t skipped;   // Untracked levels between pc[0] and pc[1]
+    const void *pc[stack_chain_sz];   // Innermost first
+  };
+  struct InstrumentStackFn {
+    uint32_t fn;
+    uint16_t depth[2];  // INSTRUMENT_STACK_CONT, INSTRUMENT_STACK_SYS
+  };
+  struct InstrumentStackWater {
+    uint32_t magic;
+    uint32_t dropped;   // Per function table full
+    struct InstrumentStackLow low[2];
+    struct InstrumentStackFn fn[stack_fn_sz];
+  } instrument_stack __attribute__((section(".noinit")));
+
+  enum { INSTRUMENT_STACK_CONT = 0, INSTRUMENT_STACK_SYS = 1 };
+
+  // Also called from the hooks, IRAM
+  void IRAM_ATTR NO_INSTRUMENT backtraceLog_instrument_stack_clear(void) {
+    uint32_t saved_ps = xt_rsil(15);
+    ets_memset(&instrument_stack, 0, sizeof(instrument_stack));
+    instrument_stack.magic = stack_magic;
+    xt_wsr_ps(saved_ps);
+  }
+
+  static inline __attribute__((always_inline))
+  void instrument_stack_enter(void *this_fn, void *pc, void *sp, ssize_t level) {
+    if (stack_magic != instrument_stack.magic) {
+      backtraceLog_instrument_stack_clear();
+    }
+
+    uintptr_t addr = (uintptr_t)sp;
+    uintptr_t cont_end = (uintptr_t)g_pcont->stack_end;
+    size_t id = INSTRUMENT_STACK_SYS;
+    uint32_t depth = sys_stack_end - addr;
+    if (addr >= (uintptr_t)g_pcont->stack && addr < cont_end) {
+      id = INSTRUMENT_STACK_CONT;
+      depth = cont_end - addr;
+    }
+    if (depth > 0xFFFFu) {
+      return; // Not a stack we know
+    }
+
+    struct InstrumentStackLow *low = &instrument_stack.low[id];
+    if (depth > low->depth) {
+      uint32_t saved_ps = xt_rsil(15);
+      if (depth > low->depth) {
+        low->depth = depth;
+        size_t n = 0;
+        ssize_t i = level;
+        low->skipped = 0;
+        if (level >= stack_sz) {
+          // Not on the tracking stack, lead with this function
+          low->pc[n++] = pc;
+          low->skipped = level - stack_sz;
+          i = stack_sz - 1;
+        }
+        for (; i >= 0 && n < stack_chain_sz; i--) {
+          low->pc[n++] = hwdt_last_call.last[i].pc;
+        }
+        low->count = n;
+      }
+      xt_wsr_ps(saved_ps);
+    }
+
+    uint32_t fn = (uint32_t)(uintptr_t)this_fn;
+    size_t idx = (fn ^ (fn >> 9)) & (stack_fn_sz - 1u);
+    for (size_t probe = 0; probe < stack_fn_probe; probe++) {
+      struct InstrumentStackFn *e = &instrument_stack.fn[idx];
+      if (0 == e->fn) {
+        uint32_t saved_ps = xt_rsil(15);
+        if (0 == e->fn) {
+          e->fn = fn;
+        }
+        xt_wsr_ps(saved_ps);
+      }
+      if (fn == e->fn) {
+        if (depth > e->depth[id]) {
+          e->depth[id] = depth;
+        }
+        return;
+      }
+      idx = (idx + 1u) & (stack_fn_sz - 1u);
+    }
+    instrument_stack.dropped++;
+  }
+#else
+  static inline __attribute__((always_inline))
+  void instrument_stack_enter(void *this_fn, void *pc, void *sp, ssize_t level) { (void)this_fn; (void)pc; (void)sp; (void)level; }
+#endif // #if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0)
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Maintain hwdt_last_call stack, it will contain the last valid
+  // pc:stack-frame pair to backtrace from.
+  //
+  IRAM_ATTR void __cyg_profile_func_enter(void *this_fn, void *call_site) NO_INSTRUMENT;
+  IRAM_ATTR void __cyg_profile_func_exit(void *this_fn, void *call_site) NO_INSTRUMENT;
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST
+  /*
+    Hand coded versions of the C hooks below. No stack frame and no call, only
+    the caller saved registers a4 - a7 are used. The asm has the structure
+    layouts built in, keep these in sync.
+
+    As with the C version, level is updated with a single load/store. An
+    interrupt between the two, with instrumented functions, leaves level
+    unchanged. An event recorded by such an interrupt may be overwritten.
+  */
+  static_assert(0 == offsetof(struct StackLastPCPS, level), "asm offsets");
+  static_assert(4 == offsetof(struct StackLastPCPS, last), "asm offsets");
+  static_assert(8 == sizeof(struct LastPCPS), "asm uses addx8");
+#if (DEBUG_ESP_BACKTRACELOG_EVENT_RING > 0)
+  static_assert(0 == offsetof(struct HwdtEventRing, head), "asm offsets");
+  static_assert(4 == offsetof(struct HwdtEventRing, event), "asm offsets");
+  static_assert(8 == sizeof(struct HwdtEvent), "asm uses addx8");
+
+  // a2 = fn, with bit 0 set for exit
+  #define INSTRUMENT_EVENT_RECORD_ASM \
+    "movi     a4,   hwdt_event_ring\n\t" \
+    "l32i.n   a5,   a4,   0\n\t"         \
+    "rsr.ccount a7\n\t"                   \
+    "addi.n   a6,   a5,   1\n\t"         \
+    "s32i.n   a6,   a4,   0\n\t"         \
+    "movi     a6,   " INSTRUMENT_STR(DEBUG_ESP_BACKTRACELOG_EVENT_RING) " - 1\n\t" \
+    "and      a5,   a5,   a6\n\t"        \
+    "addx8    a5,   a5,   a4\n\t"        \
+    "s32i.n   a2,   a5,   4\n\t"         \
+    "s32i.n   a7,   a5,   8\n\t"
+#else
+  #define INSTRUMENT_EVENT_RECORD_ASM
+#endif
+
+  asm (
+    ".section        .iram.text.cyg_profile_func,\"ax\",@progbits\n\t"
+    ".literal_position\n\t"
+    ".global __cyg_profile_func_enter\n\t"
+    ".type   __cyg_profile_func_enter, @function\n\t"
+    ".align  4\n"
+  "__cyg_profile_func_enter:\n\t"
+    "movi     a4,   hwdt_last_call\n\t"
+    "l32i.n   a5,   a4,   0\n\t"         // level
+    "addi.n   a6,   a5,   1\n\t"
+    "s32i.n   a6,   a4,   0\n\t"         // level++
+    "movi     a6,   " INSTRUMENT_STR(INSTRUMENT_STACK_SZ) "\n\t"
+    "bgeu     a5,   a6,   1f\n\t"        // unsigned, also skips level < 0
+    "addx8    a5,   a5,   a4\n\t"
+    "s32i.n   a0,   a5,   4\n\t"         // last[level].pc
+    "s32i.n   a1,   a5,   8\n"            // last[level].sp
+  "1:\n\t"
+    INSTRUMENT_EVENT_RECORD_ASM
+    "ret.n\n\t"
+    ".size __cyg_profile_func_enter, .-__cyg_profile_func_enter\n\t"
+
+    ".global __cyg_profile_func_exit\n\t"
+    ".type   __cyg_profile_func_exit, @function\n\t"
+    ".align  4\n"
+  "__cyg_profile_func_exit:\n\t"
+    "movi     a4,   hwdt_last_call\n\t"
+    "l32i.n   a5,   a4,   0\n\t"
+    "blti     a5,   1,    2f\n\t"        // Stop at 0
+    "addi.n   a5,   a5,   -1\n\t"
+    "s32i.n   a5,   a4,   0\n"
+  "2:\n\t"
+    "addi.n   a2,   a2,   1\n\t"         // Mark exit, fn is 4 byte aligned
+    INSTRUMENT_EVENT_RECORD_ASM
+    "ret.n\n\t"
+    ".size __cyg_profile_func_exit, .-__cyg_profile_func_exit\n\t"
+  );
+
+#else // #if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST
+  static IRAM_ATTR void hwdt_profile_func_enter(void *pc, void *sp, void *this_fn) __attribute__((used,no_instrument_function));
+
+  void hwdt_profile_func_enter(void *pc, void *sp, void *this_fn) {
+    if (!instrument_filter_match(this_fn)) return;
+
+    ssize_t level = hwdt_last_call.level;
+    hwdt_last_call.level++;
+    // memory fence, above computations cannot be moved below.
+    // This should make us safe from ISR contamination. level is held in a register.
+    __asm__ __volatile__("" ::: "memory"); // this would be _GLIBCXX_READ_MEM_BARRIER in atomicity.h
+
+    // Make stack saturation is harmless. We continue to track stack levels
+    // above stack_sz so we know where we are when it comes back down.
+    if (stack_sz > level && 0 <= level) {
+      // The case "0 <= level" should never fail, Just incase.
+      hwdt_last_call.last[level].pc = pc;
+      hwdt_last_call.last[level].sp = sp;
+    }
+    instrument_histogram_enter(level);
+    instrument_stack_enter(this_fn, pc, sp, level);
+    hwdt_event_record(this_fn, 0u);
+  }
+
+#if defined(__XTENSA__)
+  /*
+    Short ASM wrapper to capture callers PC:stack-fame and pass to our logger.
+    this_fn arrives in a2 and is passed on in a4.
+  */
+  asm (
+    ".section        .iram.text.cyg_profile_func,\"ax\",@progbits\n\t"
+    ".literal_position\n\t"
+    ".global __cyg_profile_func_enter\n\t"
+    ".type   __cyg_profile_func_enter, @function\n\t"
+    ".align  4\n"
+  "__cyg_profile_func_enter:\n\t"
+    "mov      a4,   a2\n\t"
+    "mov      a3,   a1\n\t"
+    "mov      a2,   a0\n\t"
+    "addi     a1,   a1,   -16\n\t"
+    "s32i.n   a0,   a1,   12\n\t"
+    "call0    hwdt_profile_func_enter\n\t"
+    "l32i.n   a0,   a1,   12\n\t"
+    "addi     a1,   a1,   16\n\t"
+    "ret.n\n\t"
+    ".size __cyg_profile_func_enter, .-__cyg_profile_func_enter\n\t"
+  );
+#endif // Host builds, tests/host, call hwdt_profile_func_enter() directly.
+
+  /*
+    Called with identical values as described for __cyg_profile_func_enter.
+    Track stack level. Stop at 0, an exit without a matching enter happens
+    when tracking starts part way down a call chain.
+  */
+  void __cyg_profile_func_exit(void *this_fn, void *call_site) {
+    (void)call_site;
+    if (!instrument_filter_match(this_fn)) return;
+
+    ssize_t level = hwdt_last_call.level;
+    if (level > 0) {
+      level--;
+      hwdt_last_call.level = level;
+      instrument_histogram_exit(this_fn, level);
+    }
+    hwdt_event_record(this_fn, 1u);
+  }
+#endif // #if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST
+
+};
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0)
+void NO_INSTRUMENT backtraceLog_instrument_histogram_dump(Print& out) {
+    out.printf_P(PSTR("Histogram buckets: %u, dropped: %u\r\n"),
+        histogram_buckets, histogram_dropped);
+
+    for (size_t i = 0; i < histogram_sz; i++) {
+        uint32_t saved_ps = xt_rsil(15);
+        struct InstrumentHistogram e = histogram_table[i];
+        xt_wsr_ps(saved_ps);
+        if (0 == e.fn) continue;
+
+        // Only the buckets in use, "<bucket>:<count>"
+        out.printf_P(PSTR("Histogram: 0x%08x"), e.fn);
+        for (size_t b = 0; b < histogram_buckets; b++) {
+            if (e.count[b]) {
+                out.printf_P(PSTR(" %u:%u"), b, e.count[b]);
+            }
+        }
+        out.printf_P(PSTR("\r\n"));
+    }
+}
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0)
+void NO_INSTRUMENT backtraceLog_instrument_stack_report(Print& out) {
+    static const char * const stack_name[2] = { "cont", "sys" };
+
+    if (stack_magic != instrument_stack.magic) {
+        out.printf_P(PSTR("Stack high-water: no data\r\n"));
+        return;
+    }
+    for (size_t id = 0; id < 2; id++) {
+        uint32_t saved_ps = xt_rsil(15);
+        struct InstrumentStackLow low = instrument_stack.low[id];
+        xt_wsr_ps(saved_ps);
+        if (0 == low.depth) continue;
+
+        out.printf_P(PSTR("Stack high-water %s: %u bytes\r\n  Backtrace:"), stack_name[id], low.depth);
+        for (size_t i = 0; i < low.count; i++) {
+            out.printf_P(PSTR(" %p"), low.pc[i]);
+        }
+        out.printf_P(PSTR("\r\n"));
+        if (low.skipped) {
+            out.printf_P(PSTR("  Untracked levels after the first: %u\r\n"), low.skipped);
+        }
+    }
+
+    out.printf_P(PSTR("Stack per function, dropped: %u\r\n"), instrument_stack.dropped);
+    for (size_t i = 0; i < stack_fn_sz; i++) {
+        uint32_t saved_ps = xt_rsil(15);
+        struct InstrumentStackFn e = instrument_stack.fn[i];
+        xt_wsr_ps(saved_ps);
+        if (0 == e.fn) continue;
+
+        // Depth in bytes, from the top of the stack to the function's frame
+        out.printf_P(PSTR("Stack: 0x%08x cont %u sys %u\r\n"),
+            e.fn, e.depth[INSTRUMENT_STACK_CONT], e.depth[INSTRUMENT_STACK_SYS]);
+    }
+}
+#endif
+
+#endif // #if DEBUG_ESP_BACKTRACELOG_INSTRUMENT
@@ -0,0 +1,171 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACEINSTRUMENT_H
+#define _BACKTRACEINSTRUMENT_H
+
+#include <Arduino.h>
+
+/*
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT=1 - BacktraceLog provides the
+  __cyg_profile_func_enter/exit functions needed by the "-finstrument-functions"
+  build option. Do not also define them in your sketch.
+
+  A stack of the last PC:SP pairs is maintained for the HWDT backtrace. When
+  built with HWDT or HWDT_NOEXTRA4K, the results are reported and logged at
+  reboot from the HWDT Stack Dump callback.
+
+  DEBUG_ESP_BACKTRACELOG_EVENT_RING - number of function enter/exit events, with
+  CCOUNT, kept in a ring buffer. Must be a power of 2, 0 disables. After a HWDT,
+  the events are printed as a timeline and the most recent are added to the log.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST=1 - use hand coded asm enter/exit
+  hooks. They do the same bookkeeping without a stack frame or a call into C.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER - number of address ranges in the
+  runtime filter table, 0 disables. When the table is not empty, only functions
+  with an entry point inside a range are tracked. Not available with
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM - number of functions with a log2
+  histogram of elapsed cycles per call, 0 disables. Must be a power of 2. Each
+  entry is 52 bytes. Not available with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK - number of functions with a recorded
+  deepest stack use, 0 disables. Must be a power of 2. Each entry is 8 bytes in
+  noinit. Not available with DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST.
+
+  DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW=1 - the postmortem crash callback
+  takes the user space backtrace from the PC:SP stack, the shadow stack, in
+  place of the heuristic unwinder. Falls back to the unwinder when the shadow
+  stack is empty.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT 0
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST 0
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_EVENT_RING
+#define DEBUG_ESP_BACKTRACELOG_EVENT_RING 64
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER 0
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FILTER > 0)
+/*
+  Add the range [start, end) to the filter table. Overlapping ranges are
+  merged. Returns false when the table is full.
+
+  A function that returns across a change of the table can leave the tracked
+  level off by one. Change the table from loop(), not from deep inside a call.
+*/
+extern "C" bool backtraceLog_instrument_filter_add(const void *start, const void *end);
+
+// Empty the filter table, all functions are tracked.
+extern "C" void backtraceLog_instrument_filter_clear(void);
+
+#else
+static inline __attribute__((always_inline))
+bool backtraceLog_instrument_filter_add(const void *start, const void *end) { (void)start; (void)end; return false; }
+static inline __attribute__((always_inline))
+void backtraceLog_instrument_filter_clear(void) {}
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM 0
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_HISTOGRAM > 0)
+/*
+  Print one "Histogram:" line per function, the entry address followed by
+  "<bucket>:<count>" pairs. Bucket b counts calls taking [2^(b-1), 2^b) cycles.
+  Use scripts/histogram_report.sh to symbolize.
+*/
+void backtraceLog_instrument_histogram_dump(Print& out=Serial);
+extern "C" void backtraceLog_instrument_histogram_clear(void);
+
+#else
+static inline __attribute__((always_inline))
+void backtraceLog_instrument_histogram_dump(Print& out=Serial) { (void)out; }
+static inline __attribute__((always_inline))
+void backtraceLog_instrument_histogram_clear(void) {}
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK 0
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT && (DEBUG_ESP_BACKTRACELOG_INSTRUMENT_STACK > 0)
+/*
+  Print the low-water mark of the cont and sys stacks, each with the call chain
+  that reached it. Then one "Stack:" line per function with the deepest frame
+  seen, in bytes from the top of each stack. Results persist across restarts.
+*/
+void backtraceLog_instrument_stack_report(Print& out=Serial);
+extern "C" void backtraceLog_instrument_stack_clear(void);
+
+#else
+static inline __attribute__((always_inline))
+void backtraceLog_instrument_stack_report(Print& out=Serial) { (void)out; }
+static inline __attribute__((always_inline))
+void backtraceLog_instrument_stack_clear(void) {}
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW
+#define DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW 0
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT
+/*
+  Backtrace from the shadow stack kept by the enter/exit hooks. Nothing is
+  disassembled, each level costs two reads. Fills pc[] with one PC per tracked
+  function, innermost first. Each PC is just past the function's prologue, not
+  the call site. Only instrumented functions appear. Returns the number of
+  levels.
+
+  When mismatch is not NULL, each level is cross-checked with the heuristic
+  unwinder, a few steps from a level must reach the frame of the level below
+  it. The number of levels that do not is returned in *mismatch.
+*/
+extern "C" size_t backtraceLog_instrument_backtrace(const void **pc, size_t max, size_t *mismatch);
+
+/*
+  As above, when sp is not NULL it is filled with each level's SP, which tells
+  the cont stack levels from the SYS stack levels.
+*/
+extern "C" size_t backtraceLog_instrument_backtrace_ex(const void **pc, const void **sp, size_t max, size_t *mismatch);
+
+#else
+static inline __attribute__((always_inline))
+size_t backtraceLog_instrument_backtrace(const void **pc, size_t max, size_t *mismatch) {
+    (void)pc; (void)max;
+    if (mismatch) *mismatch = 0;
+    return 0;
+}
+static inline __attribute__((always_inline))
+size_t backtraceLog_instrument_backtrace_ex(const void **pc, const void **sp, size_t max, size_t *mismatch) {
+    (void)pc; (void)sp; (void)max;
+    if (mismatch) *mismatch = 0;
+    return 0;
+}
+#endif
+
+#endif // _BACKTRACEINSTRUMENT_H
@@ -0,0 +1,66 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACEIRQTRACE_H
+#define _BACKTRACEIRQTRACE_H
+
+/*
+  Interrupts-disabled latency tracer hooks. With DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+  set, the core's xt_rsil() and xt_wsr_ps() macros are replaced, for the code
+  that includes this file, with versions that time each section with interrupts
+  off. The longest are kept with a backtrace in the BacktraceLog record and
+  printed by BacktraceLog::report().
+
+  Include after any core header, or from `<sketch name>.ino.globals.h` to
+  cover everything built with the sketch:
+
+    #if !defined(__ASSEMBLER__) && __has_include(<BacktraceIrqTrace.h>)
+    #include <BacktraceIrqTrace.h>
+    #endif
+
+  Interrupts disabled by other means, like ets_intr_lock(), are not timed.
+
+  This file is included in C, C++, and core builds; keep it free of Arduino.h.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+#define DEBUG_ESP_BACKTRACELOG_IRQ_TRACE 0
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE && !defined(__ASSEMBLER__)
+#include <stdint.h>
+#include <core_esp8266_features.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Call with the level requested and the PS value returned by rsil, returns it
+uint32_t backtraceLog_irq_off(uint32_t level, uint32_t state);
+// Writes state to PS
+void backtraceLog_irq_restore(uint32_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef xt_rsil
+#define xt_rsil(level) (backtraceLog_irq_off((level), __extension__({uint32_t state; __asm__ __volatile__("rsil %0," __STRINGIFY(level) : "=a" (state) :: "memory"); state;})))
+
+#undef xt_wsr_ps
+#define xt_wsr_ps(state) backtraceLog_irq_restore(state)
+
+#endif // #if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE && !defined(__ASSEMBLER__)
+#endif // _BACKTRACEIRQTRACE_H
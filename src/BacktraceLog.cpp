@@ -89,6 +89,9 @@ extern "C" uint32_t __crc_val;
 
 #if (DEBUG_ESP_BACKTRACELOG_MAX > 0)
 #include "backtrace.h"
+#include "BacktraceAlloc.h"
+#include "BacktraceInstrument.h"
+#include "BacktraceSymbols.h"
 
 union BacktraceLogUnion {
     struct BACKTRACE_LOG log;
@@ -113,6 +116,7 @@ static struct RTC_STATUS {
 } rtc_status __attribute__((section(".noinit")));
 
 constexpr size_t baseSize32BacktraceLog = offsetof(union BacktraceLogUnion, log.pc) / sizeof(uint32_t);
+constexpr size_t pcSize32BacktraceLog = sizeof(((union BacktraceLogUnion *)0)->log.pc[0]) / sizeof(uint32_t);
 #endif
 
 #if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
@@ -122,6 +126,459 @@ constexpr size_t baseSize32BacktraceLog = offsetof(union BacktraceLogUnion, log.
 // The block should be in 8-byte increments and fall on an 8-byte alignment.
 #define IRAM_RESERVE_SZ ((sizeof(union BacktraceLogUnion) + 7) & ~7)
 
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+#if !DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER
+#error "DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT requires DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER=1"
+#endif
+/*
+  Stack snapshot - kept in IRAM right after the log buffer. IRAM only supports
+  32-bit access, everything here is handled as 32-bit words.
+
+  data[] holds a list of windows. Each window starts with two words, the stack
+  address and the number of stack words it covers. Stack words follow with
+  simple zero compression; a zero word is always followed by a word with the
+  count of consecutive zero words it stands for.
+*/
+struct BACKTRACE_SNAPSHOT {
+    uint32_t crashCount;  // Matches log.crashCount when snapshot is current
+    uint32_t max;         // Size of data[], words
+    uint32_t used;        // Words used in data[]
+    uint32_t data[];
+};
+
+#define SNAPSHOT_RESERVE_SZ ((DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT + 7) & ~7)
+constexpr size_t snapshotMax32 = (SNAPSHOT_RESERVE_SZ - sizeof(struct BACKTRACE_SNAPSHOT)) / sizeof(uint32_t);
+static_assert(SNAPSHOT_RESERVE_SZ >= sizeof(struct BACKTRACE_SNAPSHOT) + 16 * sizeof(uint32_t),
+    "DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT is too small, 80 bytes minimum");
+
+// Range of DRAM, the only place we expect to find a stack
+constexpr uintptr_t dram_start = 0x3FFE8000u;
+constexpr uintptr_t dram_end   = 0x40000000u;
+
+struct BACKTRACE_SNAPSHOT *pSnap = NULL;
+
+// Last window saved, used to skip overlapping stack
+static uintptr_t snap_start, snap_end;
+
+static void snapshot_init(bool zero) {
+    if (zero || snapshotMax32 != pSnap->max || pSnap->used > pSnap->max) {
+        pSnap->crashCount = 0;
+        pSnap->max = snapshotMax32;
+        pSnap->used = 0;
+    }
+}
+
+static void snapshot_begin(void) {
+    if (NULL == pSnap) return;
+
+    pSnap->crashCount = pBT->log.crashCount;
+    pSnap->used = 0;
+    snap_start = snap_end = 0;
+}
+
+// Append stack words [addr, addr + sz) as a new window, space permitting.
+static void snapshot_window(uintptr_t addr, size_t sz) {
+    if (NULL == pSnap) return;
+
+    uintptr_t end = (addr + sz + 3) & ~3;
+    addr &= ~3;
+    if (addr >= snap_start && addr < snap_end) {
+        addr = snap_end;
+    }
+    if (addr < dram_start || end > dram_end || addr >= end) return;
+
+    size_t used = pSnap->used;
+    const size_t hdr = used;
+    if (used + 3 > pSnap->max) return;
+    used += 2;
+
+    const uint32_t *stk = (const uint32_t *)addr;
+    const size_t len32 = (end - addr) / sizeof(uint32_t);
+    size_t n = 0;
+    while (n < len32) {
+        if (stk[n]) {
+            if (used + 1 > pSnap->max) break;
+            pSnap->data[used++] = stk[n++];
+        } else {
+            if (used + 2 > pSnap->max) break;
+            size_t run = 1;
+            while (n + run < len32 && 0 == stk[n + run]) run++;
+            pSnap->data[used++] = 0;
+            pSnap->data[used++] = run;
+            n += run;
+        }
+    }
+    if (0 == n) return;
+
+    pSnap->data[hdr] = addr;
+    pSnap->data[hdr + 1] = n;
+    pSnap->used = used;
+    snap_start = addr;
+    snap_end = addr + n * sizeof(uint32_t);
+}
+
+struct SNAPSHOT_ITER {
+    size_t idx;       // next data[] word to read
+    uintptr_t addr;   // stack address of the next word
+    size_t left;      // words left in current window
+    size_t zeros;     // zero words left in current run
+};
+
+static bool snapshot_is_current(void) {
+    return pSnap && pSnap->used && pSnap->used <= pSnap->max &&
+           pSnap->crashCount == pBT->log.crashCount;
+}
+
+// Expand the snapshot one stack word at a time. Returns false at the end.
+static bool snapshot_next(struct SNAPSHOT_ITER *it, uintptr_t *addr, uint32_t *val) {
+    const size_t used = pSnap->used;
+    while (0 == it->left) {
+        if (it->idx + 2 > used) return false;
+        it->addr = pSnap->data[it->idx];
+        it->left = pSnap->data[it->idx + 1];
+        it->idx += 2;
+        it->zeros = 0;
+    }
+    if (it->zeros) {
+        it->zeros--;
+        *val = 0;
+    } else {
+        if (it->idx >= used) return false;
+        *val = pSnap->data[it->idx++];
+        if (0 == *val) {
+            if (it->idx >= used) return false;
+            it->zeros = pSnap->data[it->idx++] - 1;
+        }
+    }
+    *addr = it->addr;
+    it->addr += sizeof(uint32_t);
+    it->left--;
+    return true;
+}
+
+#else
+static inline void snapshot_begin(void) {}
+static inline void snapshot_window(uintptr_t addr, size_t sz) { (void)addr; (void)sz; }
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+#if !defined(BACKTRACE_IN_IRAM) || !BACKTRACE_IN_IRAM
+#error "DEBUG_ESP_BACKTRACELOG_IRQ_TRACE requires -DBACKTRACE_IN_IRAM=1, the backtrace is run with interrupts off"
+#endif
+/*
+  Interrupts-disabled latency tracer. BacktraceIrqTrace.h replaces the core's
+  xt_rsil() and xt_wsr_ps() macros with calls to backtraceLog_irq_off() and
+  backtraceLog_irq_restore(). The time from raising INTLEVEL above 0 to
+  lowering it to 0, by xt_wsr_ps() or by xt_rsil(0) as with interrupts(), is
+  measured with CCOUNT.
+
+  When a section takes longer than the shortest in the table, the xt_rsil() call
+  site and a backtrace from the closing call site are saved. CCOUNT is read
+  first and PS restored before the backtrace, so the tracer does not lengthen
+  the section it measures. The table, for this boot, is in DRAM. It is merged
+  into the top-N table in the log buffer at crash time and by
+  backtraceLog_irq_trace_commit().
+
+  These may run with the flash cache off, all code and data used must be in
+  IRAM or DRAM. BacktraceIrqTrace.h may have replaced xt_rsil() and xt_wsr_ps()
+  here too; the tracer's own critical sections use irq_raw_disable() and
+  irq_raw_restore() so they are not timed.
+*/
+constexpr size_t irq_trace_sz = DEBUG_ESP_BACKTRACELOG_IRQ_TRACE;
+constexpr size_t irq_trace_depth = DEBUG_ESP_BACKTRACELOG_IRQ_TRACE_DEPTH;
+
+static struct BACKTRACE_IRQ_OFF irq_trace[irq_trace_sz];   // Longest first
+static uint32_t irq_trace_min;      // Must be longer than this to get in the table
+static uint32_t irq_off_ccount;
+static const void *irq_off_pc;
+static bool irq_off_active;
+
+extern "C" {
+static uint32_t do_checksum(union BacktraceLogUnion *p);
+};
+
+// IRAM only supports 32-bit access
+static inline __attribute__((always_inline))
+void irq_trace_copy(struct BACKTRACE_IRQ_OFF *dst, const struct BACKTRACE_IRQ_OFF *src) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+    for (size_t i = 0; i < sizeof(struct BACKTRACE_IRQ_OFF) / sizeof(uint32_t); i++) {
+        d[i] = s[i];
+    }
+}
+
+static inline __attribute__((always_inline)) uint32_t irq_ccount(void) {
+    uint32_t ccount;
+    __asm__ __volatile__("rsr.ccount %0\n\t" : "=a"(ccount));
+    return ccount;
+}
+
+static inline __attribute__((always_inline)) uint32_t irq_raw_disable(void) {
+    uint32_t state;
+    __asm__ __volatile__("rsil %0,15" : "=a" (state) :: "memory");
+    return state;
+}
+
+static inline __attribute__((always_inline)) void irq_raw_restore(uint32_t state) {
+    __asm__ __volatile__("wsr %0,ps; isync" :: "a" (state) : "memory");
+}
+
+/*
+  Always inline, there should only be one frame, ours, between the unwinder
+  start and the call site closing the section. The backtrace is taken with
+  interrupts enabled, into a local copy, and inserted with them off.
+*/
+static inline __attribute__((always_inline))
+void irq_trace_insert(uint32_t cycles, const void *rsil_pc, const void *lr) {
+    struct BACKTRACE_IRQ_OFF e;
+    e.cycles = cycles;
+    e.rsil_pc = rsil_pc;
+
+    const void *pc, *sp, *fn;
+    __asm__ __volatile__(
+      "mov  %[sp], a1\n\t"
+      "movi %[pc], .\n\t"
+      : [pc]"=r"(pc), [sp]"=r"(sp)
+      :
+      : "memory");
+    size_t n = 0;
+    while (n < irq_trace_depth &&
+           xt_retaddr_callee_ex(pc, sp, lr, &pc, &sp, &fn)) {
+        e.pc[n++] = pc;
+        lr = NULL;
+    }
+    for (; n < irq_trace_depth; n++) {
+        e.pc[n] = NULL;
+    }
+
+    uint32_t saved_ps = irq_raw_disable();
+    if (cycles > irq_trace_min) {
+        size_t i = irq_trace_sz - 1u;
+        while (i > 0 && cycles > irq_trace[i - 1u].cycles) {
+            irq_trace_copy(&irq_trace[i], &irq_trace[i - 1u]);
+            i--;
+        }
+        irq_trace_copy(&irq_trace[i], &e);
+        irq_trace_min = irq_trace[irq_trace_sz - 1u].cycles;
+    }
+    irq_raw_restore(saved_ps);
+}
+
+/*
+  Close the open section. CCOUNT and the xt_rsil() call site are read first,
+  then, when restore is set, PS is written. xt_rsil(0) has already lowered
+  INTLEVEL.
+*/
+static inline __attribute__((always_inline))
+void irq_trace_close(bool restore, uint32_t state, const void *lr) {
+    uint32_t cycles = irq_ccount() - irq_off_ccount;
+    const void *rsil_pc = irq_off_pc;
+    irq_off_active = false;
+    if (restore) {
+        irq_raw_restore(state);
+    }
+    if (cycles > irq_trace_min) {
+        irq_trace_insert(cycles, rsil_pc, lr);
+    }
+}
+
+extern "C" IRAM_ATTR uint32_t backtraceLog_irq_off(uint32_t level, uint32_t state) {
+    if (0 == (state & 0x0Fu)) {
+        if (level) {
+            irq_off_pc = __builtin_return_address(0);
+            irq_off_active = true;
+            irq_off_ccount = irq_ccount();
+        }
+    } else if (0 == level && irq_off_active) {
+        irq_trace_close(false, state, __builtin_return_address(0));
+    }
+    return state;
+}
+
+extern "C" IRAM_ATTR void backtraceLog_irq_restore(uint32_t state) {
+    if (0 == (state & 0x0Fu) && irq_off_active) {
+        irq_trace_close(true, state, __builtin_return_address(0));
+    } else {
+        irq_raw_restore(state);
+    }
+}
+
+/*
+  Merge this boot's table with the log buffer's, keeping the longest, into
+  merged[]. Neither table is changed.
+*/
+static void irq_trace_merge(struct BACKTRACE_IRQ_OFF *merged) {
+    uint32_t saved_ps = irq_raw_disable();
+    size_t a = 0, b = 0;
+    for (size_t i = 0; i < irq_trace_sz; i++) {
+        if (pBT->log.irqOff[a].cycles >= irq_trace[b].cycles) {
+            irq_trace_copy(&merged[i], &pBT->log.irqOff[a++]);
+        } else {
+            irq_trace_copy(&merged[i], &irq_trace[b++]);
+        }
+    }
+    irq_raw_restore(saved_ps);
+}
+
+/*
+  Merge this boot's table into the log buffer's. The boot table is then
+  emptied, with the entry threshold left at the log's shortest. Caller updates
+  the checksum.
+*/
+static void irq_trace_save(void) {
+    if (NULL == pBT) return;
+
+    struct BACKTRACE_IRQ_OFF merged[irq_trace_sz];
+    irq_trace_merge(merged);
+    uint32_t saved_ps = irq_raw_disable();
+    for (size_t i = 0; i < irq_trace_sz; i++) {
+        irq_trace_copy(&pBT->log.irqOff[i], &merged[i]);
+    }
+    memset(irq_trace, 0, sizeof(irq_trace));
+    irq_trace_min = merged[irq_trace_sz - 1u].cycles;
+    irq_raw_restore(saved_ps);
+}
+
+// Outside of a crash, merge then reseal the log and update the RTC backup.
+void backtraceLog_irq_trace_commit(void) {
+    if (NULL == pBT) return;
+
+    irq_trace_save();
+    pBT->log.chksum = do_checksum(pBT);
+#if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+    if (rtc_status.size) {
+        system_rtc_mem_write(DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET, &pBT->word32[0], rtc_status.size);
+    }
+#endif
+}
+
+static void irq_trace_clear(void) {
+    uint32_t saved_ps = irq_raw_disable();
+    memset(irq_trace, 0, sizeof(irq_trace));
+    irq_trace_min = 0;
+    irq_raw_restore(saved_ps);
+}
+#else
+static inline void irq_trace_save(void) {}
+static inline void irq_trace_clear(void) {}
+#endif // #if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+#if !defined(BACKTRACE_IN_IRAM) || !BACKTRACE_IN_IRAM
+#error "DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST requires -DBACKTRACE_IN_IRAM=1, the backtrace is run from an ISR"
+#endif
+/*
+  Soft WDT assist. A Soft WDT reset leaves a poor backtrace. The exception
+  frame is for the WDT's NMI, and when the loop is in a leaf function, a0 was
+  never saved to the stack.
+
+  The Soft WDT is fed when the SYS context runs. An os_timer in SYS updates a
+  heartbeat. A timer0 interrupt checks it, and once the heartbeat is older than
+  DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS, samples the interrupted PC, A0 and SP
+  from the level 1 exception frame at each tick. The samples are held in DRAM
+  and only saved to the log when the crash callback sees a Soft WDT reset. If
+  the heartbeat resumes, the samples are dropped.
+
+  The interrupt is masked while interrupts are disabled, a loop spinning with
+  INTLEVEL raised is left for the HWDT.
+*/
+constexpr size_t swdt_sample_sz = DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST;
+constexpr uint32_t swdt_heartbeat_ms = 100;
+constexpr uint32_t swdt_tick_ms = 50;
+
+static struct BACKTRACE_SWDT swdt_stage;
+static uint32_t swdt_heartbeat;     // CCOUNT of the last SYS heartbeat
+static uint32_t swdt_threshold;     // CPU cycles
+static uint32_t swdt_tick;          // CPU cycles
+static uint32_t swdt_stalled;       // CPU cycles, at the first sample
+static ETSTimer swdt_heartbeat_timer;
+
+static inline __attribute__((always_inline)) uint32_t swdt_ccount(void) {
+    uint32_t ccount;
+    __asm__ __volatile__("rsr.ccount %0\n\t" : "=a"(ccount));
+    return ccount;
+}
+
+static void swdt_heartbeat_cb(void *arg) {
+    (void)arg;
+    swdt_heartbeat = swdt_ccount();
+}
+
+static IRAM_ATTR void swdt_assist_isr(void) {
+    uint32_t now = swdt_ccount();
+    timer0_write(now + swdt_tick);
+
+    uint32_t stalled = now - swdt_heartbeat;
+    if (stalled < swdt_threshold) {
+        swdt_stage.count = 0;     // False alarm, SYS ran
+        return;
+    }
+    if (swdt_stage.count >= swdt_sample_sz) return;
+
+    const void *a0 = NULL;
+    struct BACKTRACE_PC_SP pc_sp = xt_interrupted_pc_sp(&a0);
+    if (NULL == pc_sp.pc) return;
+
+    if (0 == swdt_stage.count) {
+        swdt_stalled = stalled;
+        swdt_stage.pcLow = NULL;
+        swdt_stage.pcHigh = NULL;
+    }
+    struct BACKTRACE_SWDT_SAMPLE *s = &swdt_stage.sample[swdt_stage.count++];
+    s->pc = pc_sp.pc;
+    s->a0 = a0;
+    s->sp = pc_sp.sp;
+
+    // Only the loop, on the cont stack, is expected to be looping.
+    if ((uintptr_t)pc_sp.sp >= (uintptr_t)g_pcont->stack &&
+        (uintptr_t)pc_sp.sp < (uintptr_t)g_pcont->stack_end) {
+        if (NULL == swdt_stage.pcLow || pc_sp.pc < swdt_stage.pcLow) {
+            swdt_stage.pcLow = pc_sp.pc;
+        }
+        if (pc_sp.pc > swdt_stage.pcHigh) {
+            swdt_stage.pcHigh = pc_sp.pc;
+        }
+    }
+}
+
+void backtraceLog_swdt_assist_begin(void) {
+    uint32_t cycles_per_ms = ets_get_cpu_frequency() * 1000u;
+    swdt_threshold = DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS * cycles_per_ms;
+    swdt_tick = swdt_tick_ms * cycles_per_ms;
+    swdt_stage.count = 0;
+    swdt_heartbeat = swdt_ccount();
+
+    os_timer_disarm(&swdt_heartbeat_timer);
+    os_timer_setfn(&swdt_heartbeat_timer, swdt_heartbeat_cb, NULL);
+    os_timer_arm(&swdt_heartbeat_timer, swdt_heartbeat_ms, true);
+
+    timer0_isr_init();
+    timer0_attachInterrupt(swdt_assist_isr);
+    timer0_write(swdt_ccount() + swdt_tick);
+}
+
+void backtraceLog_swdt_assist_end(void) {
+    timer0_detachInterrupt();
+    os_timer_disarm(&swdt_heartbeat_timer);
+    swdt_stage.count = 0;
+}
+
+// At crash time, after backtraceLog_begin() cleared the log's copy.
+static void swdt_assist_save(const struct rst_info *rst_info) {
+    if (REASON_SOFT_WDT_RST != rst_info->reason || 0 == swdt_stage.count) return;
+
+    swdt_stage.stalled = swdt_stalled / (ets_get_cpu_frequency() * 1000u);
+    // IRAM only supports 32-bit access
+    uint32_t *d = (uint32_t *)&pBT->log.swdt;
+    const uint32_t *s = (const uint32_t *)&swdt_stage;
+    for (size_t i = 0; i < sizeof(struct BACKTRACE_SWDT) / sizeof(uint32_t); i++) {
+        d[i] = s[i];
+    }
+}
+#else
+static inline void swdt_assist_save(const struct rst_info *rst_info) { (void)rst_info; }
+#endif // #if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+
 extern struct rst_info resetInfo;
 
 /*
@@ -151,7 +608,7 @@ int BacktraceLog::read(uint32_t *p, size_t sz) {
 
     size_t limit = (sz < pBT->log.count) ? sz : pBT->log.count;
     for (size_t i = 0; i < limit; i++) {
-        p[i] = (uint32_t)pBT->log.pc[i];
+        p[i] = (uint32_t)(uintptr_t)pBT->log.pc[i];
     }
 
     return limit;
@@ -193,6 +650,7 @@ void BacktraceLog::report(Print& out) {
         out.printf_P(PSTR("  Crash count: %u\r\n"), pBT->log.crashCount);
     }
     if (pBT->log.count) {
+        out.printf_P(PSTR("  Build CRC: 0x%08X\r\n"), pBT->log.binCrc);
         if (pBT->log.binCrc != __crc_val) {
           out.printf_P(PSTR("  Current '.bin' CRC, 0x%08X, does not match Backtrace's, 0x%08X\r\n"), __crc_val, pBT->log.binCrc);
         }
@@ -203,17 +661,79 @@ void BacktraceLog::report(Print& out) {
                 pBT->log.rst_info.epc2, pBT->log.rst_info.epc3,
                 pBT->log.rst_info.excvaddr, pBT->log.rst_info.depc);
         }
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+        if (pBT->log.sys.uptime) {
+            out.printf_P(PSTR("  Heap free: %u\r\n"), pBT->log.sys.heapFree);
+            out.printf_P(PSTR("  Cont stack free: %u, Uptime: %u ms\r\n"),
+                pBT->log.sys.contStackFree, pBT->log.sys.uptime);
+        }
+#endif
         out.printf("  Backtrace:");
         for (size_t i = 0; i < pBT->log.count; i++) {
             out.printf_P(PSTR(" %p"), pBT->log.pc[i]);
         }
         out.printf_P(PSTR("\r\n"));
-        if (0x4000050cu == (uint32_t)pBT->log.pc[pBT->log.count - 1]) {
+#if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+        for (size_t i = 0; i < pBT->log.count; i++) {
+            char name[64];
+            uint32_t offset;
+            if (backtraceLog_symbol(pBT->log.pc[i], name, sizeof(name), &offset)) {
+                out.printf_P(PSTR("    %p %s+0x%x\r\n"), pBT->log.pc[i], name, offset);
+            }
+        }
+#endif
+        if (0x4000050cu == (uintptr_t)pBT->log.pc[pBT->log.count - 1]) {
             out.printf_P(PSTR("  Backtrace Context: level 1 Interrupt Handler\r\n"));
         }
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+        if (snapshot_is_current()) {
+            out.printf_P(PSTR("  Stack snapshot: %u of %u words\r\n>>>stack>>>\r\n"), pSnap->used, pSnap->max);
+            struct SNAPSHOT_ITER it = {0, 0, 0, 0};
+            uintptr_t addr, next = 0;
+            uint32_t val;
+            size_t col = 0;
+            while (snapshot_next(&it, &addr, &val)) {
+                if (addr != next || 4 == col) {
+                    if (col) out.printf_P(PSTR("\r\n"));
+                    out.printf_P(PSTR("%08x: "), addr);
+                    col = 0;
+                }
+                out.printf_P(PSTR(" %08x"), val);
+                next = addr + sizeof(uint32_t);
+                col++;
+            }
+            if (col) out.printf_P(PSTR("\r\n"));
+            out.printf_P(PSTR("<<<stack<<<\r\n"));
+        }
+#endif
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+        if (pBT->log.swdt.count) {
+            out.printf_P(PSTR("  Soft WDT assist, SYS starved: %u ms, looping PC range: %p - %p\r\n  Samples PC:A0:SP:\r\n"),
+                pBT->log.swdt.stalled, pBT->log.swdt.pcLow, pBT->log.swdt.pcHigh);
+            for (size_t i = 0; i < pBT->log.swdt.count && i < DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST; i++) {
+                out.printf_P(PSTR("   %p:%p:%p\r\n"),
+                    pBT->log.swdt.sample[i].pc, pBT->log.swdt.sample[i].a0, pBT->log.swdt.sample[i].sp);
+            }
+        }
+#endif
     } else {
         out.printf_P(PSTR("  Backtrace empty\r\n"));
     }
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+    // The log's entries with this boot's, the log is not changed
+    struct BACKTRACE_IRQ_OFF irqOff[irq_trace_sz];
+    irq_trace_merge(irqOff);
+    for (size_t i = 0; i < irq_trace_sz && irqOff[i].cycles; i++) {
+        if (0 == i) {
+            out.printf_P(PSTR("  Longest interrupts off, CPU cycles, xt_rsil() site, Backtrace from the closing site:\r\n"));
+        }
+        out.printf_P(PSTR("  %10u %p:"), irqOff[i].cycles, irqOff[i].rsil_pc);
+        for (size_t j = 0; j < irq_trace_depth && irqOff[i].pc[j]; j++) {
+            out.printf_P(PSTR(" %p"), irqOff[i].pc[j]);
+        }
+        out.printf_P(PSTR("\r\n"));
+    }
+#endif
 }
 
 void BacktraceLog::clear(Print& out) {
@@ -283,7 +803,7 @@ static uint32_t do_checksum(union BacktraceLogUnion *p) {
         chksum = xorChecksum16(&p->log.max,
             offsetof(union BacktraceLogUnion, log.pc)/2
             - offsetof(union BacktraceLogUnion, log.max)/2
-            + DEBUG_ESP_BACKTRACELOG_MAX * 2);
+            + DEBUG_ESP_BACKTRACELOG_MAX * sizeof(p->log.pc[0]) / 2);
     }
     return chksum;
 }
@@ -318,6 +838,7 @@ void backtraceLog_report(int (*ets_printf_P)(const char *fmt, ...)) {
         ets_printf_P(PSTR("  Crash count: %u\r\n"), pBT->log.crashCount);
     }
     if (pBT->log.count) {
+        ets_printf_P(PSTR("  Build CRC: 0x%08X\r\n"), pBT->log.binCrc);
         if (pBT->log.binCrc != __crc_val) {
           ets_printf_P(PSTR("  Current '.bin' CRC, 0x%08X, does not match Backtrace's, 0x%08X\r\n"), __crc_val, pBT->log.binCrc);
         }
@@ -328,17 +849,79 @@ void backtraceLog_report(int (*ets_printf_P)(const char *fmt, ...)) {
                 pBT->log.rst_info.epc2, pBT->log.rst_info.epc3,
                 pBT->log.rst_info.excvaddr, pBT->log.rst_info.depc);
         }
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+        if (pBT->log.sys.uptime) {
+            ets_printf_P(PSTR("  Heap free: %u\r\n"), pBT->log.sys.heapFree);
+            ets_printf_P(PSTR("  Cont stack free: %u, Uptime: %u ms\r\n"),
+                pBT->log.sys.contStackFree, pBT->log.sys.uptime);
+        }
+#endif
         ets_printf("  Backtrace:");
         for (size_t i = 0; i < pBT->log.count; i++) {
             ets_printf_P(PSTR(" %p"), pBT->log.pc[i]);
         }
         ets_printf_P(PSTR("\r\n"));
-        if (0x4000050cu == (uint32_t)pBT->log.pc[pBT->log.count - 1]) {
+#if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+        for (size_t i = 0; i < pBT->log.count; i++) {
+            char name[64];
+            uint32_t offset;
+            if (backtraceLog_symbol(pBT->log.pc[i], name, sizeof(name), &offset)) {
+                ets_printf_P(PSTR("    %p %s+0x%x\r\n"), pBT->log.pc[i], name, offset);
+            }
+        }
+#endif
+        if (0x4000050cu == (uintptr_t)pBT->log.pc[pBT->log.count - 1]) {
             ets_printf_P(PSTR("  Backtrace Context: level 1 Interrupt Handler\r\n"));
         }
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+        if (snapshot_is_current()) {
+            ets_printf_P(PSTR("  Stack snapshot: %u of %u words\r\n>>>stack>>>\r\n"), pSnap->used, pSnap->max);
+            struct SNAPSHOT_ITER it = {0, 0, 0, 0};
+            uintptr_t addr, next = 0;
+            uint32_t val;
+            size_t col = 0;
+            while (snapshot_next(&it, &addr, &val)) {
+                if (addr != next || 4 == col) {
+                    if (col) ets_printf_P(PSTR("\r\n"));
+                    ets_printf_P(PSTR("%08x: "), addr);
+                    col = 0;
+                }
+                ets_printf_P(PSTR(" %08x"), val);
+                next = addr + sizeof(uint32_t);
+                col++;
+            }
+            if (col) ets_printf_P(PSTR("\r\n"));
+            ets_printf_P(PSTR("<<<stack<<<\r\n"));
+        }
+#endif
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+        if (pBT->log.swdt.count) {
+            ets_printf_P(PSTR("  Soft WDT assist, SYS starved: %u ms, looping PC range: %p - %p\r\n  Samples PC:A0:SP:\r\n"),
+                pBT->log.swdt.stalled, pBT->log.swdt.pcLow, pBT->log.swdt.pcHigh);
+            for (size_t i = 0; i < pBT->log.swdt.count && i < DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST; i++) {
+                ets_printf_P(PSTR("   %p:%p:%p\r\n"),
+                    pBT->log.swdt.sample[i].pc, pBT->log.swdt.sample[i].a0, pBT->log.swdt.sample[i].sp);
+            }
+        }
+#endif
     } else {
         ets_printf_P(PSTR("  Backtrace empty\r\n"));
     }
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+    // The log's entries with this boot's, the log is not changed
+    struct BACKTRACE_IRQ_OFF irqOff[irq_trace_sz];
+    irq_trace_merge(irqOff);
+    for (size_t i = 0; i < irq_trace_sz && irqOff[i].cycles; i++) {
+        if (0 == i) {
+            ets_printf_P(PSTR("  Longest interrupts off, CPU cycles, xt_rsil() site, Backtrace from the closing site:\r\n"));
+        }
+        ets_printf_P(PSTR("  %10u %p:"), irqOff[i].cycles, irqOff[i].rsil_pc);
+        for (size_t j = 0; j < irq_trace_depth && irqOff[i].pc[j]; j++) {
+            ets_printf_P(PSTR(" %p"), irqOff[i].pc[j]);
+        }
+        ets_printf_P(PSTR("\r\n"));
+    }
+#endif
 }
 
 void backtraceLog_clear(void) {
@@ -349,6 +932,12 @@ void backtraceLog_clear(void) {
                   + sizeof(pBT->log.pc[0]) * pBT->log.max;
         // memset(&pBT->log.crashCount, 0, sz);
         memset(&pBT->word32[start_wd], 0, sz);
+        irq_trace_clear();
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+        if (pSnap) {
+            pSnap->used = 0;
+        }
+#endif
 
 #if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
         if (rtc_status.size) {
@@ -359,6 +948,123 @@ void backtraceLog_clear(void) {
     }
 }
 
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+/*
+  Capture heap and system state for the crash record. Only O(1) reads; the
+  heap may be the cause of the crash, and a walk of a corrupt free list with
+  interrupts off can run until the HWDT.
+*/
+static void save_sys_state(void) {
+    struct BACKTRACE_SYS_STATE *sys = &pBT->log.sys;
+    sys->uptime = millis();
+    sys->contStackFree = cont_get_free_stack(g_pcont);
+    sys->heapFree = umm_free_heap_size_lw();
+    backtraceLog_fin();
+}
+#else
+static inline void save_sys_state(void) {}
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT && DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW
+static inline bool on_cont_stack(const void *sp) {
+    return (uintptr_t)sp >= (uintptr_t)g_pcont->stack && (uintptr_t)sp < (uintptr_t)g_pcont->stack_end;
+}
+
+/*
+  Log the user space backtrace from the instrument hooks' shadow stack, the
+  crashing PC first, with a stack window at each level's SP. Levels the
+  unwinder could not confirm are counted and shown.
+
+  When the crash is in an instrumented function, the innermost level is that
+  same function, already logged by the crashing PC, and is skipped. It is the
+  same frame when its SP is the crash SP, or when one unwinder step from each
+  finds the same function start and caller SP. A crash in uninstrumented code
+  keeps it.
+
+  The shadow stack is shared by cont and SYS. After a crash on the SYS stack
+  while loop() is yielded, it continues into the suspended cont levels; those
+  are left to the cont unwind that follows. Returns false when there is
+  nothing from the shadow stack to log, the unwinder is used.
+*/
+static bool shadow_backtrace(const void *pc, const void *sp) {
+    const void *shadow[DEBUG_ESP_BACKTRACELOG_MAX];
+    const void *shadow_sp[DEBUG_ESP_BACKTRACELOG_MAX];
+    size_t mismatch = 0;
+    size_t n = backtraceLog_instrument_backtrace_ex(shadow, shadow_sp, DEBUG_ESP_BACKTRACELOG_MAX - 1u, &mismatch);
+    if (g_pcont->PC_SUSPEND && !on_cont_stack(sp)) {
+        size_t sys = 0;
+        while (sys < n && !on_cont_stack(shadow_sp[sys])) sys++;
+        n = sys;
+    }
+    if (0 == n) return false;
+
+    size_t first = 0;
+    if (sp == shadow_sp[0]) {
+        first = 1;
+    } else {
+        const void *crash_pc, *crash_sp, *crash_fn;
+        const void *level_pc, *level_sp, *level_fn;
+        if (xt_retaddr_callee_ex(pc, sp, NULL, &crash_pc, &crash_sp, &crash_fn) &&
+            xt_retaddr_callee_ex(shadow[0], shadow_sp[0], NULL, &level_pc, &level_sp, &level_fn) &&
+            crash_fn && crash_fn == level_fn && crash_sp == level_sp) {
+            first = 1;
+        }
+    }
+
+    backtraceLog_write(pc);
+    snapshot_window((uintptr_t)sp, DEBUG_ESP_BACKTRACELOG_STACK_WINDOW);
+    ETS_PRINTF2(" %p", pc);
+    SHOW_PRINTF(" %p", pc);
+    for (size_t i = first; i < n; i++) {
+        backtraceLog_write(shadow[i]);
+        snapshot_window((uintptr_t)shadow_sp[i], DEBUG_ESP_BACKTRACELOG_STACK_WINDOW);
+        ETS_PRINTF2(" %p", shadow[i]);
+        SHOW_PRINTF(" %p", shadow[i]);
+    }
+    if (mismatch) {
+        ETS_PRINTF2("\n  Shadow stack: %u levels not confirmed by the unwinder", mismatch);
+        SHOW_PRINTF("\n  Shadow stack: %u levels not confirmed by the unwinder", mismatch);
+    }
+    return true;
+}
+#else
+static inline bool shadow_backtrace(const void *pc, const void *sp) { (void)pc; (void)sp; return false; }
+#endif
+
+/*
+  Locate the exception frame from the stack range postmortem passes to the
+  crash callback. The frame is the 256 bytes reserved by the User Exception
+  vector, just below `stack`. Postmortem arrives at `stack` from a tally of its
+  own stack use, which can drift between core versions; the positions within
+  exception_frame_slack bytes are also tried, nearest first. A frame is
+  accepted when it fits below `stack_end` and its saved epc matches epc1.
+*/
+constexpr size_t exception_frame_size = 256u;   // Reserved by the User Exception vector
+constexpr size_t exception_frame_slack = 64u;
+
+static bool exception_frame_in_dram(uintptr_t frame) {
+    return 0 == (frame & 3u) && frame >= 0x3FFE8000u && frame + exception_frame_size <= 0x40000000u;
+}
+
+static struct __exception_frame *exception_frame_find(const struct rst_info *rst_info, uint32_t stack, uint32_t stack_end) {
+    if (0 == rst_info->epc1 || stack < exception_frame_size) {
+        return NULL;
+    }
+    const uintptr_t guess = (stack - exception_frame_size) & ~15u;
+    for (size_t off = 0; off <= exception_frame_slack; off += 16u) {
+        for (int dir = 0; dir < 2; dir++) {
+            if (0 == off && dir) continue;
+            uintptr_t f = (dir) ? guess - off : guess + off;
+            if (!exception_frame_in_dram(f) || f + exception_frame_size > stack_end) continue;
+            struct __exception_frame *frame = (struct __exception_frame *)f;
+            if (frame->epc == rst_info->epc1) {
+                return frame;
+            }
+        }
+    }
+    return NULL;
+}
+
 /*
   The Boot ROM `__divsi3` function handles a divide by 0 by branching to the
   `ill` instruction at address 0x4000dce5. By looking for this address in epc1
@@ -367,9 +1073,6 @@ void backtraceLog_clear(void) {
 constexpr uint32_t divide_by_0_exception = 0x4000dce5u;
 
 void SHARE_CUSTOM_CRASH_CB__DEBUG_ESP_BACKTRACELOG(struct rst_info * rst_info, uint32_t stack, uint32_t stack_end) {
-    (void)stack;
-    (void)stack_end;
-
     const void *i_pc, *i_sp, *lr, *pc, *sp;
     [[maybe_unused]] const void *fn;
     int repeat;
@@ -379,47 +1082,64 @@ void SHARE_CUSTOM_CRASH_CB__DEBUG_ESP_BACKTRACELOG(struct rst_info * rst_info, u
     }
 
     backtraceLog_begin(rst_info);
+    snapshot_begin();
     // Assume no exception frame to work with. As with software abort/panic/...
     struct __exception_frame * frame = NULL;
     if (rst_info->reason < 100) {
-        // Backtrace up to the Exception Frame
-        //
-        // Postmortem may change and the offsets for adjusting before the
-        // exception frame could become stale. Backward search for the start of
-        // the exception frame from here.
-        const struct BACKTRACE_PC_SP pc_sp = xt_return_address_ex(0);
-        pc = pc_sp.pc;
-        sp = pc_sp.sp;
-
-        lr = NULL;
         ETS_PRINTF2("\n\nBacktrace Crash Reporter - Exception space:\n ");
-        do {
-            i_pc = pc;
-            i_sp = sp;
-            ETS_PRINTF2(" %p:%p", i_pc, i_sp);
-            repeat = xt_retaddr_callee_ex(i_pc, i_sp, NULL, &pc, &sp, &fn);
-            ETS_PRINTF2("(%d)", (int)i_sp - (int)sp);
-            if (fn) { ETS_PRINTF2(":<%p>", fn); }
-        } while (repeat > 0);
-        ETS_PRINTF2("\n");
-        ETS_PRINTF2("  Frame: 0x%08x, Backtrace Frame: 0x%08x\n", (uintptr_t)frame, (uint32_t)i_sp);
-        ETS_PRINTF2("  i_pc: 0x%08x, pc: 0x%08x\n", (uint32_t)i_pc, (uint32_t)pc);
-        ETS_PRINTF2("  i_sp: 0x%08x, sp: 0x%08x\n", (uint32_t)i_sp, (uint32_t)sp);
-
-        frame = (struct __exception_frame * )sp;
+        frame = exception_frame_find(rst_info, stack, stack_end);
+        if (frame) {
+            ETS_PRINTF2(" stack: 0x%08x, stack_end: 0x%08x\n", stack, stack_end);
+            ETS_PRINTF2("  Frame: 0x%08x\n", (uintptr_t)frame);
+        } else {
+            // Backtrace up to the Exception Frame
+            //
+            // Not where postmortem's stack argument says, or the saved epc
+            // does not match. Backward search for the start of the exception
+            // frame from here.
+            const struct BACKTRACE_PC_SP pc_sp = xt_return_address_ex(0);
+            pc = pc_sp.pc;
+            sp = pc_sp.sp;
+
+            do {
+                i_pc = pc;
+                i_sp = sp;
+                ETS_PRINTF2(" %p:%p", i_pc, i_sp);
+                repeat = xt_retaddr_callee_ex(i_pc, i_sp, NULL, &pc, &sp, &fn);
+                ETS_PRINTF2("(%d)", (int)((uintptr_t)i_sp - (uintptr_t)sp));
+                if (fn) { ETS_PRINTF2(":<%p>", fn); }
+            } while (repeat > 0);
+            ETS_PRINTF2("\n");
+            ETS_PRINTF2("  Backtrace Frame: 0x%08x\n", (uint32_t)(uintptr_t)i_sp);
+            ETS_PRINTF2("  i_pc: 0x%08x, pc: 0x%08x\n", (uint32_t)(uintptr_t)i_pc, (uint32_t)(uintptr_t)pc);
+            ETS_PRINTF2("  i_sp: 0x%08x, sp: 0x%08x\n", (uint32_t)(uintptr_t)i_sp, (uint32_t)(uintptr_t)sp);
+
+            if (exception_frame_in_dram((uintptr_t)sp)) {
+                frame = (struct __exception_frame * )sp;
+                if (frame->epc != rst_info->epc1) {
+                    ETS_PRINTF2("  Frame epc: 0x%08x, epc1: 0x%08x\n", frame->epc, rst_info->epc1);
+                }
+            } else {
+                // Nothing safe to read, report as with software abort/panic/...
+                ETS_PRINTF2("  No exception frame\n");
+            }
+        }
+    }
+    if (frame) {
+        snapshot_window((uintptr_t)frame, sizeof(struct __exception_frame));
         uint32_t epc1 = rst_info->epc1;
         uint32_t exccause = rst_info->exccause;
 
-        pc = (void*)epc1;
-        lr = (void*)frame->a0;
-        sp = (void*)((uintptr_t)frame + 256); // Step back before the exception occured
+        pc = (void*)(uintptr_t)epc1;
+        lr = (void*)(uintptr_t)frame->a0;
+        sp = (void*)((uintptr_t)frame + exception_frame_size); // Step back before the exception occured
         if (rst_info->epc2) {
-            pc = (void*)rst_info->epc2;
+            pc = (void*)(uintptr_t)rst_info->epc2;
         } else if (0 == exccause && divide_by_0_exception == epc1) {
             // In place of the detached 'ILL' instruction., redirect attention
             // back to the code that called the ROM divide function.
             pBT->log.rst_info.exccause = 6 /* EXCCAUSE_DIVIDE_BY_ZERO */;
-            pBT->log.rst_info.epc1 = (uint32_t)lr;
+            pBT->log.rst_info.epc1 = (uint32_t)(uintptr_t)lr;
             pc = lr;
             lr = NULL;
         }
@@ -436,21 +1156,24 @@ void SHARE_CUSTOM_CRASH_CB__DEBUG_ESP_BACKTRACELOG(struct rst_info * rst_info, u
         sp = pc_sp.sp;
         lr = NULL;
     }
-    ETS_PRINTF2("  i_pc: 0x%08x, i_sp: 0x%08x, i_lr: 0x%08x\n", (uint32_t)pc, (uint32_t)sp, (uint32_t)lr);
+    ETS_PRINTF2("  i_pc: 0x%08x, i_sp: 0x%08x, i_lr: 0x%08x\n", (uint32_t)(uintptr_t)pc, (uint32_t)(uintptr_t)sp, (uint32_t)(uintptr_t)lr);
 
 
     ETS_PRINTF2("\n\nBacktrace Crash Reporter - User space:\n ");
     SHOW_PRINTF("\nBacktrace:");
-    do {
+    if (shadow_backtrace(pc, sp)) {
+        repeat = 0;
+    } else do {
         i_pc = pc;
         i_sp = sp;
         ETS_PRINTF2(" %p:%p", pc, sp);
         SHOW_PRINTF(" %p:%p", pc, sp);
         backtraceLog_write(pc);
+        snapshot_window((uintptr_t)i_sp, DEBUG_ESP_BACKTRACELOG_STACK_WINDOW);
         repeat = xt_retaddr_callee_ex(i_pc, i_sp, lr, &pc, &sp, &fn);
-        ETS_PRINTF2("(%d)", (int)i_sp - (int)sp);
+        ETS_PRINTF2("(%d)", (int)((uintptr_t)i_sp - (uintptr_t)sp));
         if (fn) { ETS_PRINTF2(":<%p>", fn); }
-        SHOW_PRINTF("(%d)", (int)i_sp - (int)sp);
+        SHOW_PRINTF("(%d)", (int)((uintptr_t)i_sp - (uintptr_t)sp));
         if (fn) { SHOW_PRINTF(":<%p>", fn); }  // estimated start of the function
         lr = NULL;
     } while(repeat);
@@ -469,17 +1192,24 @@ void SHARE_CUSTOM_CRASH_CB__DEBUG_ESP_BACKTRACELOG(struct rst_info * rst_info, u
             ETS_PRINTF2(" %p:%p", pc, sp);
             SHOW_PRINTF(" %p:%p", pc, sp);
             backtraceLog_write(pc);
+            snapshot_window((uintptr_t)i_sp, DEBUG_ESP_BACKTRACELOG_STACK_WINDOW);
             repeat = xt_retaddr_callee_ex(i_pc, i_sp, NULL, &pc, &sp, &fn);
-            ETS_PRINTF2("(%d)", (int)i_sp - (int)sp);
+            ETS_PRINTF2("(%d)", (int)((uintptr_t)i_sp - (uintptr_t)sp));
             if (fn) { ETS_PRINTF2(":<%p>", fn); }
-            SHOW_PRINTF("(%d)", (int)i_sp - (int)sp);
+            SHOW_PRINTF("(%d)", (int)((uintptr_t)i_sp - (uintptr_t)sp));
             if (fn) { SHOW_PRINTF(":<%p>", fn); }
         } while(repeat);
     }
+    irq_trace_save();
+    swdt_assist_save(rst_info);
     backtraceLog_fin();
+    save_sys_state();
 
     ETS_PRINTF2("\n\n");
     SHOW_PRINTF("\n\n");
+#if DEBUG_ESP_BACKTRACELOG_SHOW && (DEBUG_ESP_BACKTRACELOG_ALLOC > 0)
+    backtraceLog_alloc_ets_report(umm_info_safe_printf_P, 8);
+#endif
 }
 
 
@@ -499,10 +1229,11 @@ static void rtc_check_init(union BacktraceLogUnion *pBT) {
     rtc_status.size = 0;
     rtc_status.max_depth = 0;
 
-    int free_rtc = (192 - DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET) - baseSize32BacktraceLog;
+    // PCs that fit after the header
+    int free_rtc = ((192 - DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET) - (int)baseSize32BacktraceLog) / (int)pcSize32BacktraceLog;
     if (free_rtc >= DEBUG_ESP_BACKTRACELOG_MIN) {
         rtc_status.max_depth = (free_rtc < DEBUG_ESP_BACKTRACELOG_MAX) ? free_rtc : DEBUG_ESP_BACKTRACELOG_MAX;
-        rtc_status.size = 4 * (baseSize32BacktraceLog + rtc_status.max_depth);
+        rtc_status.size = 4 * (baseSize32BacktraceLog + pcSize32BacktraceLog * rtc_status.max_depth);
         system_rtc_mem_read(DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET, &pBT->word32[0], rtc_status.size);
         if (pBT->log.max == rtc_status.max_depth && pBT->log.chksum == do_checksum(pBT)) {
             pBT->log.bootCounter++;
@@ -556,12 +1287,24 @@ static struct BACKTRACELOG_MEM_INFO set_pBT(void) {
             bool zero = !is_mem_valid() && pBT;
             backtraceLog_init(pBT, DEBUG_ESP_BACKTRACELOG_MAX, zero);
             rtc_check_init(pBT);
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+            if ((ssize_t)(IRAM_RESERVE_SZ + SNAPSHOT_RESERVE_SZ) <= iram_buffer_sz) {
+                pSnap = (struct BACKTRACE_SNAPSHOT *)(iram_buffer + IRAM_RESERVE_SZ);
+                snapshot_init(zero);
+            }
+#endif
         }
 
         // If you had another structure to allocate, calculate the next available
         // IRAM location and size available.
         iram_buffer += IRAM_RESERVE_SZ;
         iram_buffer_sz -= IRAM_RESERVE_SZ;
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+        if (pSnap) {
+            iram_buffer += SNAPSHOT_RESERVE_SZ;
+            iram_buffer_sz -= SNAPSHOT_RESERVE_SZ;
+        }
+#endif
     } else {
         pBT = NULL;
     }
@@ -651,6 +1394,12 @@ void backtraceLog_begin(struct rst_info *reset_info) {
     } else {
         memset(&pBT->log.rst_info, 0, sizeof(struct rst_info));
     }
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+    memset(&pBT->log.sys, 0, sizeof(pBT->log.sys));
+#endif
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+    memset(&pBT->log.swdt, 0, sizeof(pBT->log.swdt));
+#endif
     pBT->log.crashCount++;
     pBT->log.count = 0;
 }
@@ -17,6 +17,7 @@
 #ifndef _BACKTRACELOG_H
 #define _BACKTRACELOG_H
 
+#include <stddef.h>
 #include <user_interface.h>
 
 // Enable minimum logging at postmortem
@@ -51,6 +52,62 @@
 #define DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET 0
 #endif
 
+/*
+  Number of bytes of left over IRAM to reserve, after the log buffer, for a
+  compressed snapshot of the exception frame and the stack around each
+  backtrace SP. Requires DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER. 0 disables.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+#define DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT 0
+#endif
+
+// Bytes of stack to save starting at each backtrace SP.
+#ifndef DEBUG_ESP_BACKTRACELOG_STACK_WINDOW
+#define DEBUG_ESP_BACKTRACELOG_STACK_WINDOW 64
+#endif
+
+/*
+  Add heap and system state, at crash time, to the log record. Only values that
+  cost O(1) to read are taken, the heap is not walked. Costs 12 bytes in the
+  log buffer and RTC backup. With DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET,
+  the record must still fit in RTC memory, see BACKTRACE_LOG below.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_SYS_STATE
+#define DEBUG_ESP_BACKTRACELOG_SYS_STATE 0
+#endif
+
+/*
+  Number of longest interrupts-disabled sections to keep in the log record, 0
+  disables. Each costs 4 * (2 + DEBUG_ESP_BACKTRACELOG_IRQ_TRACE_DEPTH) bytes in
+  the log buffer and RTC backup; with RTC backup, a record that no longer fits
+  fails to compile. Code is traced when it includes
+  BacktraceIrqTrace.h. Requires -DBACKTRACE_IN_IRAM=1.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+#define DEBUG_ESP_BACKTRACELOG_IRQ_TRACE 0
+#endif
+
+// Backtrace levels saved for each interrupts-disabled section
+#ifndef DEBUG_ESP_BACKTRACELOG_IRQ_TRACE_DEPTH
+#define DEBUG_ESP_BACKTRACELOG_IRQ_TRACE_DEPTH 4
+#endif
+
+/*
+  Soft WDT assist, number of samples of the interrupted PC, A0 and SP to keep
+  when the SYS context has been starved for DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS.
+  0 disables. Each sample costs 12 bytes, plus 16 for the set, in the log
+  buffer and RTC backup; with RTC backup, a record that no longer fits fails
+  to compile. Uses timer0. Requires -DBACKTRACE_IN_IRAM=1.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+#define DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST 0
+#endif
+
+// Starts sampling this long after SYS last ran. The Soft WDT resets at about 3.2s.
+#ifndef DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS
+#define DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS 2500
+#endif
+
 #ifndef DEBUG_ESP_BACKTRACELOG_LEAF_FUNCTION
 #define DEBUG_ESP_BACKTRACELOG_LEAF_FUNCTION(...) __asm__ __volatile__("" ::: "a0", "memory")
 #endif
@@ -110,6 +167,38 @@ struct BACKTRACELOG_MEM_INFO DEBUG_ESP_BACKTRACELOG_IRAM_RESERVE_CB(void *, size
 
 // #include <user_interface.h>
 
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+struct BACKTRACE_SYS_STATE {
+    uint32_t heapFree;
+    uint32_t contStackFree;
+    uint32_t uptime;            // millis()
+};
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+struct BACKTRACE_IRQ_OFF {
+    uint32_t cycles;            // CCOUNT, xt_rsil() to xt_wsr_ps()
+    const void *rsil_pc;        // xt_rsil() call site
+    const void *pc[DEBUG_ESP_BACKTRACELOG_IRQ_TRACE_DEPTH]; // From xt_wsr_ps() call site
+};
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+struct BACKTRACE_SWDT_SAMPLE {
+    const void *pc;
+    const void *a0;
+    const void *sp;
+};
+
+struct BACKTRACE_SWDT {
+    uint32_t stalled;           // ms SYS had not run, at the first sample
+    uint32_t count;
+    const void *pcLow;          // Looping PC range, from samples on the cont stack
+    const void *pcHigh;
+    struct BACKTRACE_SWDT_SAMPLE sample[DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST];
+};
+#endif
+
 struct BACKTRACE_LOG {
     uint32_t chksum;
     uint32_t max;
@@ -117,10 +206,31 @@ struct BACKTRACE_LOG {
     uint32_t crashCount;
     uint32_t binCrc;
     struct rst_info rst_info;
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+    struct BACKTRACE_SYS_STATE sys;
+#endif
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+    struct BACKTRACE_IRQ_OFF irqOff[DEBUG_ESP_BACKTRACELOG_IRQ_TRACE]; // Longest first
+#endif
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+    struct BACKTRACE_SWDT swdt;
+#endif
     uint32_t count;
     const void *pc[DEBUG_ESP_BACKTRACELOG_MAX];
 };
 
+/*
+  The RTC backup holds the header and as many PCs as fit after it, at least
+  DEBUG_ESP_BACKTRACELOG_MIN. The optional records above grow the header; stop
+  here instead of running without the backup.
+*/
+#if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+static_assert(offsetof(struct BACKTRACE_LOG, pc) + DEBUG_ESP_BACKTRACELOG_MIN * sizeof(((struct BACKTRACE_LOG *)0)->pc[0]) <=
+    (192u - DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET) * sizeof(uint32_t),
+    "BACKTRACE_LOG header and DEBUG_ESP_BACKTRACELOG_MIN PCs do not fit in user RTC memory after DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET, "
+    "lower the offset or drop SYS_STATE, IRQ_TRACE or SWDT_ASSIST records");
+#endif
+
 class BacktraceLog {
 public:
     void report(Print& out=Serial);
@@ -133,6 +243,34 @@ public:
 extern "C" void backtraceLog_report(int (*ets_printf_P)(const char *fmt, ...));
 extern "C" void backtraceLog_clear(void);
 
+/*
+  Interrupts-disabled latency tracer. Merge this boot's longest sections into
+  the log record, reseal it, and update the RTC backup, so they survive a
+  restart. A crash does the same. Reports show both without changing the log.
+*/
+#if DEBUG_ESP_BACKTRACELOG_IRQ_TRACE
+extern "C" void backtraceLog_irq_trace_commit(void);
+#else
+static inline __attribute__((always_inline))
+void backtraceLog_irq_trace_commit(void) {}
+#endif
+
+/*
+  Soft WDT assist. Call from setup(). A SYS heartbeat timer and a timer0
+  watchdog are started. When the heartbeat stops for
+  DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST_MS, timer0 samples the interrupted context.
+  If the Soft WDT then resets, the samples are saved with the crash record.
+*/
+#if DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST
+extern "C" void backtraceLog_swdt_assist_begin(void);
+extern "C" void backtraceLog_swdt_assist_end(void);
+#else
+static inline __attribute__((always_inline))
+void backtraceLog_swdt_assist_begin(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_swdt_assist_end(void) {}
+#endif
+
 /*
   Exposed to support hwdt_pre_sdk_init(). Otherwise, not needed?
 
@@ -176,6 +314,12 @@ static inline __attribute__((always_inline))
 void backtraceLog_report(int (*ets_printf_P)(const char *fmt, ...)) { (void)ets_printf_P; }
 static inline __attribute__((always_inline))
 void backtraceLog_clear(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_swdt_assist_begin(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_swdt_assist_end(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_irq_trace_commit(void) {}
 
 static inline __attribute__((always_inline))
 void backtraceLog_begin(struct rst_info *reset_info) { (void)reset_info; }
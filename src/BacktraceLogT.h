@@ -0,0 +1,237 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACELOGT_H
+#define _BACKTRACELOGT_H
+
+#include <Arduino.h>
+#include <user_interface.h>
+#include "backtrace.h"
+#include "BacktraceLog.h"
+
+// Filled in by elf2bin.py, see BacktraceLog.cpp
+extern "C" uint32_t __crc_val;
+
+/*
+  Compile-time configured backtrace log, for logs beside the crash log.
+
+    BacktraceLogT<Depth, Storage, Record>
+
+  Depth - number of PCs held, at least 4.
+
+  Storage - where the log persists:
+    BacktraceStorageDram         noinit DRAM. Survives exceptions, WDT and
+                                 software restarts. Cheapest to write, the
+                                 choice for a high-rate trace.
+    BacktraceStorageRtc<Offset>  noinit DRAM, written through to user RTC
+                                 memory at word Offset on every write. Also
+                                 survives deep sleep and EXT_RST. Each write
+                                 costs an RTC memory write, keep the rate low.
+
+  Record - what happens when the log is full:
+    BacktraceRecordRing          overwrite the oldest PC
+    BacktraceRecordFirst         keep the first Depth PCs, drop the rest
+
+  Everything is static; each distinct instantiation is a separate log, and
+  instances of the same type share one. Layout and size are checked at compile
+  time. The choice of storage and record policy costs no runtime branching.
+
+    BacktraceLogT<64, BacktraceStorageDram, BacktraceRecordRing> traceLog;
+
+    setup():  traceLog.begin();
+    anywhere: traceLog.record(4);     // caller's backtrace, 4 levels
+              traceLog.write(pc);     // or a single PC
+    later:    traceLog.report(Serial);
+
+  record() ends each backtrace with a NULL, as with backtraceLog_write(NULL).
+  report() prints one "  Backtrace:" line per backtrace, for the usual decode
+  tools. Not for use in an ISR; the methods are not in IRAM, and
+  BacktraceStorageRtc calls the SDK's system_rtc_mem_write().
+
+  write() and clear() store to RTC memory with interrupts still disabled, so a
+  write from an interrupted context cannot leave the RTC copy behind DRAM.
+
+  IRAM and flash storage are not offered. The left over IRAM is taken by the
+  crash log and DEBUG_ESP_BACKTRACELOG_IRAM_RESERVE_CB at preinit, and a flash
+  sector erase is too slow for a log written while running.
+*/
+
+struct BacktraceStorageDram {
+    static constexpr size_t capacity = ~(size_t)0;
+    static constexpr size_t rtc_offset = 0;         // Not in RTC memory
+    static constexpr uint32_t id = 0x44u;           // 'D'
+    static const char *name() { return PSTR("DRAM"); }
+    static bool load(void *p, size_t sz) { (void)p; (void)sz; return true; }
+    static void store(const void *p, size_t off, size_t sz) { (void)p; (void)off; (void)sz; }
+};
+
+template <size_t Offset>
+struct BacktraceStorageRtc {
+    static_assert(Offset >= 64 && Offset < 192,
+        "BacktraceStorageRtc Offset is out of range (64 - 192) for user RTC memory");
+    static constexpr size_t capacity = (192 - Offset) * sizeof(uint32_t);
+    static constexpr size_t rtc_offset = Offset;
+    static constexpr uint32_t id = 0x52u;           // 'R'
+    static const char *name() { return PSTR("DRAM w/RTC"); }
+    static bool load(void *p, size_t sz) {
+        return system_rtc_mem_read(Offset, p, sz);
+    }
+    // off and sz are in bytes, multiples of 4
+    static void store(const void *p, size_t off, size_t sz) {
+        system_rtc_mem_write(Offset + off / sizeof(uint32_t), (const uint8_t *)p + off, sz);
+    }
+};
+
+struct BacktraceRecordRing {
+    static constexpr bool wrap = true;
+    static constexpr uint32_t id = 0x0100u;
+};
+
+struct BacktraceRecordFirst {
+    static constexpr bool wrap = false;
+    static constexpr uint32_t id = 0x0200u;
+};
+
+template <size_t Depth,
+          typename Storage = BacktraceStorageDram,
+          typename Record = BacktraceRecordRing>
+class BacktraceLogT {
+public:
+    struct LOG {
+        uint32_t magic;         // Layout key, anything else is reinitialized
+        uint32_t head;          // Next slot to write
+        uint32_t count;         // Slots used
+        uint32_t total;         // PCs written, including those lost
+        const void *pc[Depth];
+    };
+
+    static_assert(Depth >= 4,
+        "BacktraceLogT Depth is too small, 4 minimum");
+    static_assert(sizeof(struct LOG) <= Storage::capacity,
+        "BacktraceLogT does not fit in its storage");
+#if (DEBUG_ESP_BACKTRACELOG_MAX > 0) && DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+    static_assert(0 == Storage::rtc_offset ||
+        Storage::rtc_offset >= DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET + (sizeof(struct BACKTRACE_LOG) + 3u) / 4u ||
+        Storage::rtc_offset + (sizeof(struct LOG) + 3u) / 4u <= DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET,
+        "BacktraceStorageRtc overlaps the crash log's DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET");
+#endif
+
+    static constexpr uint32_t key = 0x42540000u ^ (uint32_t)Depth ^ Storage::id ^ Record::id;
+
+    static void begin() {
+        if (!Storage::load(&rec, sizeof(rec)) ||
+            key != rec.magic || rec.head >= Depth || rec.count > Depth) {
+            clear();
+        }
+    }
+
+    static void clear() {
+        uint32_t saved_ps = xt_rsil(15);
+        memset(&rec, 0, sizeof(rec));
+        rec.magic = key;
+        Storage::store(&rec, 0, sizeof(rec));
+        xt_wsr_ps(saved_ps);
+    }
+
+    static void write(const void * const pc) {
+        uint32_t saved_ps = xt_rsil(15);
+        rec.total++;
+        if (rec.count < Depth) {
+            rec.count++;
+        } else if (!Record::wrap) {
+            store_header();
+            xt_wsr_ps(saved_ps);
+            return;
+        }
+        size_t slot = rec.head;
+        rec.pc[slot] = pc;
+        rec.head = (slot + 1u < Depth) ? slot + 1u : 0u;
+        store_header();
+        Storage::store(&rec, offsetof(struct LOG, pc) + slot * sizeof(rec.pc[0]), sizeof(rec.pc[0]));
+        xt_wsr_ps(saved_ps);
+    }
+
+    // Write the caller's backtrace, up to levels PCs, then a NULL.
+    static void __attribute__((noinline)) record(size_t levels = 4) {
+        const void *fn;
+        struct BACKTRACE_PC_SP pc_sp = xt_return_address_ex(0);
+        const void *pc = pc_sp.pc;
+        const void *sp = pc_sp.sp;
+        if (pc) {
+            for (size_t n = 0; n < levels; n++) {
+                write(pc);
+                if (!xt_retaddr_callee_ex(pc, sp, NULL, &pc, &sp, &fn)) break;
+            }
+        }
+        write(NULL);
+    }
+
+    static int available() {
+        return rec.count;
+    }
+
+    // Copy out up to sz PCs, oldest first. Returns the number copied.
+    static int read(const void **p, size_t sz) {
+        uint32_t saved_ps = xt_rsil(15);
+        size_t n = (sz < rec.count) ? sz : rec.count;
+        size_t start = (Record::wrap && rec.count == Depth) ? rec.head : 0u;
+        for (size_t i = 0; i < n; i++) {
+            size_t slot = start + i;
+            p[i] = rec.pc[(slot < Depth) ? slot : slot - Depth];
+        }
+        xt_wsr_ps(saved_ps);
+        return n;
+    }
+
+    static void report(Print& out=Serial) {
+        out.printf_P(PSTR("Backtrace Log\r\n  Config: %S log buffer: %u bytes, Depth: %u, %S\r\n"),
+            Storage::name(), sizeof(rec), Depth, (Record::wrap) ? PSTR("ring") : PSTR("first"));
+        out.printf_P(PSTR("  Written: %u, held: %u\r\n"), rec.total, rec.count);
+        if (__crc_val) {
+            out.printf_P(PSTR("  Build CRC: 0x%08X\r\n"), __crc_val);
+        }
+        // Read in place, a copy of a large log would not fit on the stack.
+        size_t n = rec.count;
+        size_t start = (Record::wrap && n == Depth) ? rec.head : 0u;
+        bool open = false;
+        for (size_t i = 0; i < n; i++) {
+            size_t slot = start + i;
+            const void *pc = rec.pc[(slot < Depth) ? slot : slot - Depth];
+            if (NULL == pc) {
+                if (open) out.printf_P(PSTR("\r\n"));
+                open = false;
+                continue;
+            }
+            if (!open) out.printf_P(PSTR("  Backtrace:"));
+            out.printf_P(PSTR(" %p"), pc);
+            open = true;
+        }
+        if (open) out.printf_P(PSTR("\r\n"));
+    }
+
+private:
+    static void store_header() {
+        Storage::store(&rec, 0, offsetof(struct LOG, pc));
+    }
+
+    static struct LOG rec;
+};
+
+template <size_t Depth, typename Storage, typename Record>
+typename BacktraceLogT<Depth, Storage, Record>::LOG BacktraceLogT<Depth, Storage, Record>::rec
+    __attribute__((section(".noinit")));
+
+#endif // _BACKTRACELOGT_H
@@ -0,0 +1,157 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+  Sampling profiler built on the backtrace unwinder.
+
+  At each timer1 interrupt, find the exception frame for the interrupted
+  context and backtrace up to DEBUG_ESP_BACKTRACELOG_PROFILE_DEPTH levels. The
+  resulting call stack is counted in an open addressed hash table. When the
+  table is full, the sample is counted as dropped.
+
+  backtraceLog_profile_dump() prints one "Profile:" line per call stack,
+  sample count first, followed by the PCs, innermost first. Use
+  scripts/profile_fold.sh to fold the output into flame graph format.
+
+  Timer1 is shared with analogWrite, tone and Servo (waveform generator). Do not
+  use these while profiling.
+*/
+#include <Arduino.h>
+#include <esp8266_undocumented.h>
+#include "backtrace.h"
+#include "BacktraceProfile.h"
+
+#if (DEBUG_ESP_BACKTRACELOG_PROFILE > 0)
+
+#if !defined(BACKTRACE_IN_IRAM) || !BACKTRACE_IN_IRAM
+#error "DEBUG_ESP_BACKTRACELOG_PROFILE requires -DBACKTRACE_IN_IRAM=1, the backtrace is run from an ISR"
+#endif
+
+#pragma GCC optimize("Os")
+
+constexpr size_t profile_size = DEBUG_ESP_BACKTRACELOG_PROFILE;
+constexpr size_t profile_depth = DEBUG_ESP_BACKTRACELOG_PROFILE_DEPTH;
+constexpr size_t profile_probe = 8;         // Limit time spent in the ISR
+constexpr uint32_t timer1_div16_hz = 5000000u; // 80MHz APB clock / 16
+
+struct PROFILE_ENTRY {
+    uint32_t count;
+    const void *pc[profile_depth];
+};
+
+static struct PROFILE_ENTRY profile_table[profile_size];
+static uint32_t profile_samples;
+static uint32_t profile_missed;   // Interrupted context not found
+static uint32_t profile_dropped;  // Table full
+
+extern "C" {
+
+static IRAM_ATTR void profile_isr(void) {
+    const void *pc[profile_depth];
+    const void *lr = NULL;
+    const void *fn;
+
+    profile_samples++;
+    struct BACKTRACE_PC_SP pc_sp = xt_interrupted_pc_sp(&lr);
+    if (NULL == pc_sp.pc) {
+        profile_missed++;
+        return;
+    }
+
+    const void *i_pc = pc_sp.pc;
+    const void *i_sp = pc_sp.sp;
+    size_t n = 0;
+    uint32_t hash = (uint32_t)i_pc;
+    pc[n++] = i_pc;
+    while (n < profile_depth &&
+           xt_retaddr_callee_ex(i_pc, i_sp, lr, &i_pc, &i_sp, &fn)) {
+        pc[n++] = i_pc;
+        hash = hash * 31u + (uint32_t)i_pc;
+        lr = NULL;
+    }
+    for (size_t i = n; i < profile_depth; i++) {
+        pc[i] = NULL;
+    }
+
+    hash ^= hash >> 16;
+    size_t idx = hash % profile_size;
+    for (size_t probe = 0; probe < profile_probe; probe++) {
+        struct PROFILE_ENTRY *e = &profile_table[idx];
+        if (0 == e->count) {
+            for (size_t i = 0; i < profile_depth; i++) {
+                e->pc[i] = pc[i];
+            }
+            e->count = 1;
+            return;
+        }
+        size_t i = 0;
+        while (i < profile_depth && e->pc[i] == pc[i]) i++;
+        if (profile_depth == i) {
+            e->count++;
+            return;
+        }
+        if (++idx >= profile_size) {
+            idx = 0;
+        }
+    }
+    profile_dropped++;
+}
+
+void backtraceLog_profile_begin(uint32_t rate_hz) {
+    if (0 == rate_hz) {
+        rate_hz = 1000;
+    }
+    timer1_disable();
+    timer1_attachInterrupt(profile_isr);
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+    timer1_write(timer1_div16_hz / rate_hz);
+}
+
+void backtraceLog_profile_end(void) {
+    timer1_disable();
+    timer1_detachInterrupt();
+}
+
+void backtraceLog_profile_clear(void) {
+    uint32_t saved_ps = xt_rsil(15);
+    memset(profile_table, 0, sizeof(profile_table));
+    profile_samples = 0;
+    profile_missed = 0;
+    profile_dropped = 0;
+    xt_wsr_ps(saved_ps);
+}
+
+}; // extern "C" {
+
+void backtraceLog_profile_dump(Print& out) {
+    out.printf_P(PSTR("Profile samples: %u, missed: %u, dropped: %u\r\n"),
+        profile_samples, profile_missed, profile_dropped);
+
+    for (size_t i = 0; i < profile_size; i++) {
+        uint32_t saved_ps = xt_rsil(15);
+        struct PROFILE_ENTRY e = profile_table[i];
+        xt_wsr_ps(saved_ps);
+        if (0 == e.count) continue;
+
+        out.printf_P(PSTR("Profile: %u"), e.count);
+        for (size_t j = 0; j < profile_depth && e.pc[j]; j++) {
+            out.printf_P(PSTR(" %p"), e.pc[j]);
+        }
+        out.printf_P(PSTR("\r\n"));
+    }
+}
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_PROFILE > 0)
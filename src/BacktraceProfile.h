@@ -0,0 +1,59 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACEPROFILE_H
+#define _BACKTRACEPROFILE_H
+
+#include <Arduino.h>
+
+/*
+  Statistical sampling profiler. A timer1 interrupt samples the interrupted
+  PC:SP and walks a shallow backtrace. Matching call stacks are counted in a
+  fixed size table in DRAM.
+
+  DEBUG_ESP_BACKTRACELOG_PROFILE - number of call stacks the table can hold.
+  0 disables.
+
+  DEBUG_ESP_BACKTRACELOG_PROFILE_DEPTH - number of levels kept per call stack.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_PROFILE
+#define DEBUG_ESP_BACKTRACELOG_PROFILE 0
+#endif
+
+#ifndef DEBUG_ESP_BACKTRACELOG_PROFILE_DEPTH
+#define DEBUG_ESP_BACKTRACELOG_PROFILE_DEPTH 4
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_PROFILE > 0)
+
+extern "C" void backtraceLog_profile_begin(uint32_t rate_hz);
+extern "C" void backtraceLog_profile_end(void);
+extern "C" void backtraceLog_profile_clear(void);
+void backtraceLog_profile_dump(Print& out=Serial);
+
+#else // #if (DEBUG_ESP_BACKTRACELOG_PROFILE > 0)
+
+static inline __attribute__((always_inline))
+void backtraceLog_profile_begin(uint32_t rate_hz) { (void)rate_hz; }
+static inline __attribute__((always_inline))
+void backtraceLog_profile_end(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_profile_clear(void) {}
+static inline __attribute__((always_inline))
+void backtraceLog_profile_dump(Print& out=Serial) { (void)out; }
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_PROFILE > 0)
+#endif // _BACKTRACEPROFILE_H
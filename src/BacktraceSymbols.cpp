@@ -0,0 +1,114 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+  On-device symbol table.
+
+  The table is reserved here, all zeros, and written into the .elf by
+  scripts/embed_symbols.sh between linking and elf2bin.py. Since its size is
+  fixed at compile time, filling it in moves nothing. Layout, little-endian:
+
+    uint32_t magic        SYMBOLS_MAGIC, 0 when not filled in
+    uint32_t count        number of functions
+    uint32_t sizes        byte offset of uint16_t size[count]
+    uint32_t restarts     byte offset of uint32_t restart[(count + 15) / 16]
+    uint32_t names        byte offset of the name entries
+    uint32_t used         bytes used
+    uint32_t addr[count]  function starts, ascending
+
+  Name entries are prefix compressed against the previous name: one byte of
+  characters shared, one byte of characters that follow, then those
+  characters. Every 16th entry shares nothing, restart[] holds its offset from
+  names, so a lookup decodes at most 16 entries.
+
+  The table is in flash, read with aligned 32-bit loads; pgm_read_byte does
+  the same for the name bytes.
+*/
+#include <Arduino.h>
+#include "BacktraceSymbols.h"
+
+#if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+
+#define SYMBOLS_MAGIC 0x59535442u   // "BTSY"
+#define SYMBOLS_RESTART 16u
+
+struct SymbolsHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t sizes;
+    uint32_t restarts;
+    uint32_t names;
+    uint32_t used;
+    uint32_t addr[];
+};
+
+extern "C" const uint32_t backtraceLog_symbols[DEBUG_ESP_BACKTRACELOG_SYMBOLS / sizeof(uint32_t)]
+    PROGMEM __attribute__((used, aligned(4))) = { 0 };
+
+static inline uint32_t symbols_u16(const struct SymbolsHeader *t, size_t i) {
+    // sizes is 4 byte aligned, odd entries are in the upper half
+    uint32_t w = *(const uint32_t *)((uintptr_t)t + t->sizes + (i & ~1u) * 2u);
+    return (i & 1u) ? (w >> 16) : (w & 0xFFFFu);
+}
+
+extern "C" bool backtraceLog_symbol(const void *pc, char *name, size_t sz, uint32_t *offset) {
+    const struct SymbolsHeader *t;
+    // Hide the contents, all zeros at compile time, from the optimizer.
+    __asm__ ("" : "=r" (t) : "0" (backtraceLog_symbols));
+
+    if (SYMBOLS_MAGIC != t->magic || 0 == t->count || 0 == sz ||
+        t->used > sizeof(backtraceLog_symbols)) {
+        return false;
+    }
+
+    // Last function starting at or before pc
+    uint32_t addr = (uint32_t)(uintptr_t)pc;
+    size_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2u;
+        if (t->addr[mid] <= addr) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    if (0 == lo) return false;
+    size_t i = lo - 1u;
+    uint32_t off = addr - t->addr[i];
+    if (off >= symbols_u16(t, i)) return false;
+
+    // Decode from the restart point up to entry i
+    const uint32_t *restart = (const uint32_t *)((uintptr_t)t + t->restarts);
+    const uint8_t *p = (const uint8_t *)((uintptr_t)t + t->names + restart[i / SYMBOLS_RESTART]);
+    const uint8_t *end = (const uint8_t *)((uintptr_t)t + t->used);
+    size_t len = 0;
+    for (size_t j = i & ~(SYMBOLS_RESTART - 1u); j <= i; j++) {
+        if (p + 2 > end) return false;
+        size_t shared = pgm_read_byte(p++);
+        size_t n = pgm_read_byte(p++);
+        if (shared > len || p + n > end) return false;
+        len = shared;
+        for (size_t k = 0; k < n; k++, len++) {
+            uint8_t c = pgm_read_byte(p++);
+            if (len < sz - 1u) name[len] = c;
+        }
+    }
+    name[(len < sz - 1u) ? len : sz - 1u] = '\0';
+    if (offset) *offset = off;
+    return true;
+}
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
@@ -0,0 +1,52 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef _BACKTRACESYMBOLS_H
+#define _BACKTRACESYMBOLS_H
+
+#include <Arduino.h>
+
+/*
+  On-device symbol table. Reserves a table in flash that
+  scripts/embed_symbols.sh fills in after linking, with the function starts
+  and sizes and prefix-compressed names from the .elf. Reports then print
+  "0x40201298 loop()+0x1c" for each Backtrace PC, readable without the .elf.
+
+  DEBUG_ESP_BACKTRACELOG_SYMBOLS - bytes of flash to reserve for the table, 0
+  disables. About 6 bytes per function plus the names, embed_symbols.sh prints
+  the size needed.
+*/
+#ifndef DEBUG_ESP_BACKTRACELOG_SYMBOLS
+#define DEBUG_ESP_BACKTRACELOG_SYMBOLS 0
+#endif
+
+#if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+
+/*
+  Look up the function holding pc. On success, the name is copied to name,
+  truncated to sz - 1 characters, and the offset of pc from the function
+  start is returned in offset. Returns false when the table has not been
+  filled in or pc is not in any function.
+*/
+extern "C" bool backtraceLog_symbol(const void *pc, char *name, size_t sz, uint32_t *offset);
+
+#else // #if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+
+static inline __attribute__((always_inline))
+bool backtraceLog_symbol(const void *pc, char *name, size_t sz, uint32_t *offset) { (void)pc; (void)name; (void)sz; (void)offset; return false; }
+
+#endif // #if (DEBUG_ESP_BACKTRACELOG_SYMBOLS > 0)
+#endif // _BACKTRACESYMBOLS_H
@@ -50,6 +50,11 @@
 #define BACKTRACE_MAX_LOOKBACK 1024
 #endif
 
+// Hard limit on the bytes scanned backward from a PC, across all retries.
+#ifndef BACKTRACE_MAX_SCAN
+#define BACKTRACE_MAX_SCAN (64 * 1024)
+#endif
+
 #ifdef DEBUG_ESP_BACKTRACE_CPP
 #define ETS_PRINTF ets_uart_printf
 #else
@@ -73,6 +78,17 @@
 #define ROM_CODE_END                    (0x4000e328)
 #define IS_ROM_CODE(a)                  ((size_t)(a) >= ROM_BASE && (size_t)(a) < ROM_CODE_END)
 
+// Return address in the Boot ROM's _xtos_l1int_handler after calling the
+// interrupt handler. Backtraces from an ISR end here.
+#define ROM_L1INT_HANDLER_RET           (0x4000050c)
+#define EXCEPTION_FRAME_SIZE            (256)
+
+// Stacks are in DRAM. A stack address computed from a guessed frame is
+// checked before it is read.
+#define DRAM_BASE                       (0x3FFE8000)
+#define DRAM_END                        (0x40000000)
+#define IS_STACK_PTR(a)                 (0 == ((size_t)(a) & 3u) && (size_t)(a) >= DRAM_BASE && (size_t)(a) < DRAM_END)
+
 extern "C" {
 #if BACKTRACE_IN_IRAM
 IRAM_ATTR static uint32_t prev_text_size(const uint32_t pc);
@@ -83,11 +99,13 @@ IRAM_ATTR static bool verify_path_ret_to_pc(uint32_t pc, uint32_t off);
 IRAM_ATTR int xt_retaddr_callee(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp);
 IRAM_ATTR int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp, const void **o_fn);
 IRAM_ATTR struct BACKTRACE_PC_SP xt_return_address_ex(int lvl);
+IRAM_ATTR struct BACKTRACE_PC_SP xt_interrupted_pc_sp(const void **o_a0);
 IRAM_ATTR const void *xt_return_address(int lvl);
 IRAM_ATTR static uint8_t _idx(void *a);
 #endif
 
 
+#if defined(__XTENSA__)
 // Copied from mmu_iram.h - We have a special need to read IRAM code. In a debug
 // build the orginal would have validated the address range. And, panic at the
 // attempt to access the IRAM code area. Orignal comments stripped.
@@ -102,6 +120,21 @@ uint8_t _get_uint8(const void *p8) {
   return (uint8_t)val;
 }
 
+static inline __attribute__((always_inline))
+uint32_t _get_stack_uint32(const uint32_t *p32) {
+  return *p32;
+}
+
+#else
+// Host builds, tests/host, read code and stack through the test's memory
+// image. Each access is checked there.
+uint8_t backtrace_host_code_uint8(const void *p8);
+uint32_t backtrace_host_stack_uint32(const uint32_t *p32);
+
+static inline uint8_t _get_uint8(const void *p8) { return backtrace_host_code_uint8(p8); }
+static inline uint32_t _get_stack_uint32(const uint32_t *p32) { return backtrace_host_stack_uint32(p32); }
+#endif
+
 
 // Stay on the road. Return 0 for not a valid code pointer,
 //   or how far backward we can scan.
@@ -113,8 +146,8 @@ static uint32_t prev_text_size(const uint32_t pc)
     extern uint32_t _text_start, _text_end, _flash_code_end;
 
     // This covers compiled IRAM code
-    if (pc > (uint32_t)&_text_start && pc < (uint32_t)&_text_end) {
-        size = pc - (uint32_t )&_text_start;
+    if (pc > (uint32_t)(uintptr_t)&_text_start && pc < (uint32_t)(uintptr_t)&_text_end) {
+        size = pc - (uint32_t)(uintptr_t)&_text_start;
 
     } else if (IS_ROM_CODE(pc)) {
         size = pc - ROM_BASE;
@@ -123,7 +156,7 @@ static uint32_t prev_text_size(const uint32_t pc)
     // Hmm, this works for Arduino ESP8266 built stuff, what about the SDK?
     // Where are its strings and data stored in flash?
     // Assume this is good for now.
-    } else if (pc > (uint32_t)FLASH_BASE && pc < (uint32_t)&_flash_code_end) {
+    } else if (pc > (uint32_t)FLASH_BASE && pc < (uint32_t)(uintptr_t)&_flash_code_end) {
         size = pc - FLASH_BASE;
 
     // Most likely not code.
@@ -136,7 +169,7 @@ static uint32_t prev_text_size(const uint32_t pc)
 
 int xt_pc_is_valid(const void *pc)
 {
-    return prev_text_size((uint32_t)pc) ? 1 : 0;
+    return prev_text_size((uint32_t)(uintptr_t)pc) ? 1 : 0;
 }
 
 
@@ -186,7 +219,7 @@ static int find_addim_ax_a1(uint32_t pc, uint32_t off, int ax) {
         // a1 needs no adjustment
         return 0;
     }
-    for (uint8_t *p0 = (uint8_t *)(pc - off);
+    for (uint8_t *p0 = (uint8_t *)(uintptr_t)(pc - off);
         (uintptr_t)p0 < pc;
         p0 = (idx(p0, 0) & 0x08) ? &p0[2] : &p0[3]) {
         //
@@ -225,7 +258,7 @@ int find_s32i_a0_a1(uint32_t pc, uint32_t off) {
     // instruction size bit. set => two bytes / clear => 3 bytes
     //
     // Scan forward
-    for (uint8_t *p0 = (uint8_t *)(pc - off);
+    for (uint8_t *p0 = (uint8_t *)(uintptr_t)(pc - off);
         (uintptr_t)p0 < pc;
         p0 = (idx(p0, 0) & 0x08) ? &p0[2] : &p0[3]) {
         //
@@ -234,7 +267,7 @@ int find_s32i_a0_a1(uint32_t pc, uint32_t off) {
         if (idx(p0, 0) == 0x02 && (idx(p0, 1) & 0xF0) == 0x60) {
             int ax = idx(p0, 1) & 0x0F;
             // Check for addmi ax, a1, n
-            a0_off = find_addim_ax_a1((uint32_t)p0, (uintptr_t)p0 - (pc - off), ax);
+            a0_off = find_addim_ax_a1((uint32_t)(uintptr_t)p0, (uintptr_t)p0 - (pc - off), ax);
             if (a0_off >= 0) a0_off += 4 * idx(p0, 2);
             break;
         } else
@@ -244,7 +277,7 @@ int find_s32i_a0_a1(uint32_t pc, uint32_t off) {
         if (idx(p0, 0) == 0x09) {
             int ax = idx(p0, 1) & 0x0F;
             // Check for addmi ax, a1, n
-            a0_off = find_addim_ax_a1((uint32_t)p0, (uintptr_t)p0 - (pc - off), ax);
+            a0_off = find_addim_ax_a1((uint32_t)(uintptr_t)p0, (uintptr_t)p0 - (pc - off), ax);
             if (a0_off >= 0) a0_off += 4 * (idx(p0, 1) >> 4);
             break;
         }
@@ -254,7 +287,7 @@ int find_s32i_a0_a1(uint32_t pc, uint32_t off) {
 
 static
 bool verify_path_ret_to_pc(uint32_t pc, uint32_t off) {
-    uint8_t *p0 = (uint8_t *)(pc - off);
+    uint8_t *p0 = (uint8_t *)(uintptr_t)(pc - off);
     for (;
          (uintptr_t)p0 < pc;
          p0 = (idx(p0, 0) & 0x08) ? &p0[2] : &p0[3]);
@@ -273,20 +306,26 @@ bool verify_path_ret_to_pc(uint32_t pc, uint32_t off) {
 // int xt_retaddr_callee(const void *i_pc, const void *i_sp, const void *i_lr, void **o_pc, void **o_sp)
 int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp, const void **o_fn)
 {
-    uint32_t lr = (uint32_t)i_lr; // last return ??
-    uint32_t pc = (uint32_t)i_pc;
-    uint32_t sp = (uint32_t)i_sp;
+    uint32_t lr = (uint32_t)(uintptr_t)i_lr; // last return ??
+    uint32_t pc = (uint32_t)(uintptr_t)i_pc;
+    uint32_t sp = (uint32_t)(uintptr_t)i_sp;
     uint32_t fn = 0;
-    *o_fn = (void*)fn;
+    *o_fn = (void*)(uintptr_t)fn;
 
     uint32_t off = 2;
-    const uint32_t text_size = prev_text_size(pc);
+    uint32_t text_size = prev_text_size(pc);
+    if (text_size > BACKTRACE_MAX_SCAN) {
+        text_size = BACKTRACE_MAX_SCAN;
+    }
+    if (!IS_STACK_PTR(sp)) {
+        text_size = 0;
+    }
 
     // Most of the time "lr" will be set to the value in register "A0" which
     // very likely will be the return address when in a leaf function.
     // Otherwise, it could be anything. Test and disqualify early maybe allowing
     // better guesses later.
-    if (!xt_pc_is_valid((void *)lr)) {
+    if (!xt_pc_is_valid((void *)(uintptr_t)lr)) {
         lr = 0;
     }
 
@@ -302,8 +341,8 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
         (retry < BACKTRACE_MAX_RETRY) && (off < text_size) && pc;
         retry++, off++)
     {
-        pc = (uint32_t)i_pc;
-        sp = (uint32_t)i_sp;
+        pc = (uint32_t)(uintptr_t)i_pc;
+        sp = (uint32_t)(uintptr_t)i_sp;
         fn = 0;
 
         // Scan backward 1 byte at a time looking for a stack reserve or ret.n
@@ -327,7 +366,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                 // pc = ((uint32_t*)sp)[0];
                 // sp += 256;
                 pc = 0;
-                fn = (uint32_t)pb;
+                fn = (uint32_t)(uintptr_t)pb;
                 break;
             }
             //
@@ -356,9 +395,9 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                         continue;
                     } else {
                         uint32_t *sp_a0 = (uint32_t *)((uintptr_t)sp + (uintptr_t)a0_offset);
-                        ETS_PRINTF("\naddi: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, *sp_a0);
+                        ETS_PRINTF("\naddi: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, _get_stack_uint32(sp_a0));
                         fn = (pc - off) & ~3;
-                        pc = *sp_a0;
+                        pc = _get_stack_uint32(sp_a0);
                     }
                 }
 #else
@@ -372,9 +411,12 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                     continue;
                 } else {
                     uint32_t *sp_a0 = (uint32_t *)((uintptr_t)sp + (uintptr_t)a0_offset);
-                    ETS_PRINTF("\naddi: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, *sp_a0);
+                    if (!IS_STACK_PTR(sp_a0)) {
+                        continue;
+                    }
+                    ETS_PRINTF("\naddi: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, _get_stack_uint32(sp_a0));
                     fn = (pc - off) & ~3; // function entry points are aligned 4
-                    pc = *sp_a0;
+                    pc = _get_stack_uint32(sp_a0);
                 }
 #endif
                 // Get back to the caller's stack
@@ -415,7 +457,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                     //
                     for (uint8_t *psub = &pb[3];
                          psub < &pb[32];            // Expect a match within 32 bytes
-                         psub = (uint8_t*)((idx(psub, 0) & 0x80) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
+                         psub = (uint8_t*)((idx(psub, 0) & 0x08) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
                         if ((idx(psub, 0) & 0x0F) == 0x00 &&
                              idx(psub, 1) == 0x11 &&
                              idx(psub, 2) == 0xc0 &&
@@ -440,9 +482,12 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                         // fn = pc - off;
                         // pc = *(uint32_t *)(sp + a0_offset);
                         uint32_t *sp_a0 = (uint32_t *)((uintptr_t)sp + (uintptr_t)a0_offset);
-                        ETS_PRINTF("\nsub: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, *sp_a0);
+                        if (!IS_STACK_PTR(sp_a0)) {
+                            continue;
+                        }
+                        ETS_PRINTF("\nsub: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, _get_stack_uint32(sp_a0));
                         fn = (pc - off) & ~3; // function entry points are aligned 4
-                        pc = *sp_a0;
+                        pc = _get_stack_uint32(sp_a0);
                     }
 
                     sp += stk_size;
@@ -452,7 +497,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                     //
                     for (uint8_t *psub = &pb[3];
                          psub < &pb[32];            // Expect a match within 32 bytes
-                         psub = (uint8_t*)((idx(psub, 0) & 0x80) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
+                         psub = (uint8_t*)((idx(psub, 0) & 0x08) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
                         if ( idx(psub, 1) == 0x11 &&
                             (idx(psub, 0) & 0x0F) == 0x0A &&
                             (idx(pb, 0) & 0xF0) == (idx(psub, 0) & 0xF0)) {
@@ -467,7 +512,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                         //
                         for (uint8_t *psub = &pb[3];
                              psub < &pb[32];            // Expect a match within 32 bytes
-                             psub = (uint8_t*)((idx(psub, 0) & 0x80) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
+                             psub = (uint8_t*)((idx(psub, 0) & 0x08) ? ((uintptr_t)psub + 2) : ((uintptr_t)psub + 3))) {
                             if ((idx(psub, 0) & 0x0F) == 0x00 &&
                                  idx(psub, 1) == 0x11 &&
                                  idx(psub, 2) == 0x80 &&
@@ -492,9 +537,12 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
                         // fn = pc - off;
                         // pc = *(uint32_t *)(sp + a0_offset);
                         uint32_t *sp_a0 = (uint32_t *)((uintptr_t)sp + (uintptr_t)a0_offset);
-                        ETS_PRINTF("\nadd: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, *sp_a0);
+                        if (!IS_STACK_PTR(sp_a0)) {
+                            continue;
+                        }
+                        ETS_PRINTF("\nadd: pc:sp 0x%08X:0x%08X, stk_size: %d, a0_offset: %d, %p(0x%08x)\n", pc, sp, stk_size, a0_offset, sp_a0, _get_stack_uint32(sp_a0));
                         fn = (pc - off) & ~3; // function entry points are aligned 4
-                        pc = *sp_a0;
+                        pc = _get_stack_uint32(sp_a0);
                     }
 
                     sp -= stk_size;
@@ -510,7 +558,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
             //
             if ((idx(pb, 0) == 0x0d && idx(pb, 1) == 0xf0) ||
                 (idx(pb, 0) == 0x80 && idx(pb, 1) == 0x00 && idx(pb, 2) == 0x00)) {
-                ETS_PRINTF("\nRET(.N) pb: 0x%08X\n", (uint32_t)pb);
+                ETS_PRINTF("\nRET(.N) pb: 0x%08X\n", (uint32_t)(uintptr_t)pb);
 
                 // Make sure pc is reachable. Follow the code back to PC.
                 if (!verify_path_ret_to_pc(pc, off)) {
@@ -558,7 +606,7 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
             ETS_PRINTF("\n >=text_size: 0x%08X(%d) off: 0x%08X - sp: 0x%08x, pc: 0x%08x, fn: 0x%08x\n", text_size, text_size, off, sp, pc, fn);
             break;
         } else
-        if (xt_pc_is_valid((void *)pc)) {
+        if (xt_pc_is_valid((void *)(uintptr_t)pc)) {
             break;
         } else {
             ETS_PRINTF("\n!valid - sp: 0x%08x, pc: 0x%08x, fn: 0x%08x\n", sp, pc, fn);
@@ -570,9 +618,9 @@ int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const
     //
     if (off < text_size) {
       //+ TODO these two should be moved back into the if()
-        *o_sp = (void *)sp;
-        *o_pc = (void *)pc;
-        *o_fn = (void *)fn;
+        *o_sp = (void *)(uintptr_t)sp;
+        *o_pc = (void *)(uintptr_t)pc;
+        *o_fn = (void *)(uintptr_t)fn;
         if (xt_pc_is_valid(*o_pc)) {
             // We changed the output registers anyway. So the caller can
             // evaluate what to do next.
@@ -594,6 +642,7 @@ int xt_retaddr_callee(const void * const i_pc, const void * const i_sp, const vo
 }
 
 
+#if defined(__XTENSA__)
 struct BACKTRACE_PC_SP xt_return_address_ex(int lvl)
 {
     const void *i_sp;
@@ -626,6 +675,51 @@ struct BACKTRACE_PC_SP xt_return_address_ex(int lvl)
     return pc_sp;
 }
 
+struct BACKTRACE_PC_SP xt_interrupted_pc_sp(const void **o_a0)
+{
+    const void *i_sp;
+    const void *i_pc;
+    uint32_t epc1;
+
+    const void *o_pc = NULL;
+    const void *o_sp = NULL;
+    const void *o_fn;
+
+    __asm__ __volatile__(
+      "rsr.epc1 %[epc1]\n\t"
+      "mov  %[sp], a1\n\t"
+      "movi %[pc], .\n\t"
+      : [pc]"=r"(i_pc), [sp]"=r"(i_sp), [epc1]"=r"(epc1)
+      :
+      : "memory");
+
+    struct BACKTRACE_PC_SP pc_sp = {NULL, NULL};
+    for (int lvl = 16;
+         lvl && xt_retaddr_callee_ex(i_pc, i_sp, NULL, &o_pc, &o_sp, &o_fn);
+         lvl--) {
+        if (ROM_L1INT_HANDLER_RET == (uintptr_t)o_pc && IS_STACK_PTR(o_sp)) {
+            // The exception frame should be at SP. Allow for a small stack
+            // frame in the ROM handler and confirm with EPC1.
+            for (uintptr_t off = 0; off <= 64; off += 16) {
+                struct __exception_frame *frame = (struct __exception_frame *)((uintptr_t)o_sp + off);
+                if (frame->epc == epc1) {
+                    pc_sp.pc = (const void *)epc1;
+                    pc_sp.sp = (const void *)((uintptr_t)frame + EXCEPTION_FRAME_SIZE);
+                    if (o_a0) {
+                        *o_a0 = (const void *)frame->a0;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+        i_pc = o_pc;
+        i_sp = o_sp;
+    }
+
+    return pc_sp;
+}
+
 
 #if 1
 const void *xt_return_address(int lvl) {
@@ -659,5 +753,6 @@ const void *xt_return_address(int lvl)
     return xt_pc_is_valid(o_pc) ? o_pc : NULL;
 }
 #endif
+#endif // Host builds, tests/host, unwind from chosen PC:SP values instead.
 
 }; //extern "C"
@@ -76,6 +76,15 @@ struct BACKTRACE_PC_SP {
  */
 struct BACKTRACE_PC_SP xt_return_address_ex(int lvl);
 
+/**
+ * For use from a level 1 interrupt handler. Backtrace to the exception frame
+ * created at interrupt entry and return the interrupted PC:SP. When o_a0 is not
+ * NULL, it receives the interrupted a0 register.
+ *
+ * The frame found is confirmed against EPC1. Returns {NULL, NULL} if not found.
+ */
+struct BACKTRACE_PC_SP xt_interrupted_pc_sp(const void **o_a0);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,73 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host stand-in for the parts of the ESP8266 Arduino core used by this
+  library. Flash and RAM share one address space on the host, PROGMEM and
+  pgm_read_*() are plain reads. See host_core.cpp.
+*/
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+#include "c_types.h"
+#include "core_esp8266_features.h"
+#include "esp8266_undocumented.h"
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+unsigned long millis(void);
+int ets_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void *ets_memcpy(void *dst, const void *src, size_t n);
+void *ets_memset(void *s, int c, size_t n);
+#ifdef __cplusplus
+}
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    size_t printf_P(const char *fmt, ...);
+};
+
+class HardwareSerial : public Print {
+public:
+    size_t write(const uint8_t *buf, size_t size) override;
+};
+
+extern HardwareSerial Serial;
+#endif
+
+#endif // _HOST_ARDUINO_H
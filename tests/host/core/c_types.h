@@ -0,0 +1,35 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#ifndef _HOST_C_TYPES_H
+#define _HOST_C_TYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef int8_t   sint8_t;
+typedef int16_t  sint16_t;
+typedef int32_t  sint32_t;
+
+#define BIT(nr) (1UL << (nr))
+#define BIT8    0x00000100
+
+#endif // _HOST_C_TYPES_H
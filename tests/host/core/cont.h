@@ -0,0 +1,51 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#ifndef _HOST_CONT_H
+#define _HOST_CONT_H
+
+#ifndef CONT_STACKSIZE
+#define CONT_STACKSIZE 4096
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// As Arduino ESP8266 v3.1
+typedef struct cont_ {
+    void (*pc_ret)(void);
+    unsigned *sp_ret;
+    void (*pc_yield)(void);
+    unsigned *sp_yield;
+    unsigned *stack_end;
+    void (*pc_suspend)(void);
+    unsigned *sp_suspend;
+    unsigned stack_guard1;
+    unsigned stack[CONT_STACKSIZE / 4];
+    unsigned stack_guard2;
+    unsigned *struct_start;
+} cont_t;
+
+// On the host, placed in the DRAM range, see host_core.cpp
+extern cont_t *g_pcont;
+
+int cont_get_free_stack(cont_t *cont);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HOST_CONT_H
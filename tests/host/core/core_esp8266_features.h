@@ -0,0 +1,47 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  The interrupt level is a variable on the host. Tests read host_intlevel()
+  to check what ran with interrupts off.
+*/
+#ifndef _HOST_CORE_ESP8266_FEATURES_H
+#define _HOST_CORE_ESP8266_FEATURES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern uint32_t host_ps;
+extern uint32_t host_ccount;
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint32_t host_xt_rsil(uint32_t level) {
+    uint32_t state = host_ps;
+    host_ps = (state & ~15u) | (level & 15u);
+    return state;
+}
+
+#define xt_rsil(level) host_xt_rsil(level)
+#define xt_wsr_ps(state) do { host_ps = (state); } while (0)
+
+static inline uint32_t esp_get_cycle_count(void) {
+    return host_ccount;
+}
+
+#endif // _HOST_CORE_ESP8266_FEATURES_H
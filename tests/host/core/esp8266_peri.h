@@ -0,0 +1,22 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#ifndef _HOST_ESP8266_PERI_H
+#define _HOST_ESP8266_PERI_H
+
+// backtrace.cpp reads SPIRDY only when built with BACKTRACE_IN_IRAM=1, not
+// done on the host.
+
+#endif // _HOST_ESP8266_PERI_H
@@ -0,0 +1,61 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#ifndef _HOST_ESP8266_UNDOCUMENTED_H
+#define _HOST_ESP8266_UNDOCUMENTED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct __exception_frame {
+    uint32_t epc;
+    uint32_t ps;
+    uint32_t sar;
+    uint32_t unused;
+    union {
+        struct {
+            uint32_t a0;
+            // note: no a1 here!
+            uint32_t a2;
+            uint32_t a3;
+            uint32_t a4;
+            uint32_t a5;
+            uint32_t a6;
+            uint32_t a7;
+            uint32_t a8;
+            uint32_t a9;
+            uint32_t a10;
+            uint32_t a11;
+            uint32_t a12;
+            uint32_t a13;
+            uint32_t a14;
+            uint32_t a15;
+        };
+        uint32_t a_reg[15];
+    };
+    uint32_t cause;
+};
+
+// Boot ROM, placed by --defsym in the Makefile
+extern void _xtos_c_wrapper_handler(void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HOST_ESP8266_UNDOCUMENTED_H
@@ -0,0 +1,203 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include <sys/mman.h>
+#include "host_core.h"
+#include <umm_malloc/umm_malloc.h>
+
+uint32_t host_ps;
+uint32_t host_ccount;
+uint32_t host_rtc[192];
+std::vector<HostRtcWrite> host_rtc_writes;
+unsigned long host_millis;
+size_t host_heap_free;
+int host_failures;
+
+struct rst_info resetInfo;
+extern "C" {
+uint32_t __crc_len;
+uint32_t __crc_val;
+cont_t *g_pcont;
+}
+
+HardwareSerial Serial;
+
+static std::string output;
+static std::vector<std::pair<void *, size_t>> noinit;
+static uint32_t seed = 0x2545F491u;
+
+static void map_fixed(uintptr_t start, uintptr_t end) {
+    void *p = mmap((void *)start, end - start, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if ((void *)start != p) {
+        perror("host_core_begin: mmap");
+        abort();
+    }
+}
+
+static void scramble(void *p, size_t sz) {
+    uint8_t *b = (uint8_t *)p;
+    for (size_t i = 0; i < sz; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        b[i] = (uint8_t)seed;
+    }
+}
+
+void host_core_begin(void) {
+    map_fixed(host_dram_start, host_dram_end);
+    map_fixed(host_iram_start, host_iram_end);
+    // At the bottom of the DRAM range, test stacks are placed at the top.
+    g_pcont = (cont_t *)host_dram_start;
+    host_boot(REASON_DEFAULT_RST);
+}
+
+void host_noinit(void *p, size_t sz) {
+    noinit.push_back(std::make_pair(p, sz));
+}
+
+void host_boot(uint32_t reason) {
+    memset(&resetInfo, 0, sizeof(resetInfo));
+    resetInfo.reason = reason;
+    if (REASON_DEFAULT_RST == reason) {
+        scramble(host_rtc, sizeof(host_rtc));
+    }
+    if (REASON_DEFAULT_RST == reason || REASON_DEEP_SLEEP_AWAKE == reason) {
+        scramble((void *)host_dram_start, host_dram_end - host_dram_start);
+        scramble((void *)host_iram_start, host_iram_end - host_iram_start);
+        for (auto &r : noinit) {
+            scramble(r.first, r.second);
+        }
+    }
+    memset(g_pcont, 0, sizeof(cont_t));
+    host_rtc_writes.clear();
+    host_ps = 0;
+    output.clear();
+}
+
+std::string host_output(void) {
+    std::string s;
+    s.swap(output);
+    return s;
+}
+
+// PSTR() strings are passed with %S on the target, plain strings here.
+static void host_vprintf(const char *fmt, va_list ap) {
+    std::string f;
+    for (const char *p = fmt; *p; p++) {
+        f += *p;
+        if ('%' != *p) continue;
+        p++;
+        while (*p && strchr("-+ #0123456789.lhz", *p)) f += *p++;
+        if (0 == *p) break;
+        f += ('S' == *p) ? 's' : *p;
+    }
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), f.c_str(), ap);
+    output += buf;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size) {
+    output.append((const char *)buf, size);
+    return size;
+}
+
+size_t Print::printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[1024];
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0) return 0;
+    return write((const uint8_t *)buf, strlen(buf));
+}
+
+size_t Print::printf_P(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    std::string saved;
+    saved.swap(output);
+    host_vprintf(fmt, ap);
+    va_end(ap);
+    saved.swap(output);
+    return write((const uint8_t *)saved.data(), saved.size());
+}
+
+extern "C" {
+
+unsigned long millis(void) {
+    return host_millis;
+}
+
+int ets_printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    host_vprintf(fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+int umm_info_safe_printf_P(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    host_vprintf(fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+void *ets_memcpy(void *dst, const void *src, size_t n) {
+    return memcpy(dst, src, n);
+}
+
+void *ets_memset(void *s, int c, size_t n) {
+    return memset(s, c, n);
+}
+
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size) {
+    if (src_addr < 64 || src_addr * 4u + load_size > sizeof(host_rtc)) {
+        return false;
+    }
+    memcpy(des_addr, &host_rtc[src_addr], load_size);
+    return true;
+}
+
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr, uint16 save_size) {
+    if (des_addr < 64 || des_addr * 4u + save_size > sizeof(host_rtc)) {
+        return false;
+    }
+    memcpy(&host_rtc[des_addr], src_addr, save_size);
+    host_rtc_writes.push_back({des_addr, save_size, host_intlevel()});
+    return true;
+}
+
+int cont_get_free_stack(cont_t *cont) {
+    // As the core, count the words still holding the fill pattern.
+    int free = 0;
+    while (free < (int)(CONT_STACKSIZE / 4) && 0xfeefeffeu == cont->stack[free]) {
+        free++;
+    }
+    return free * 4;
+}
+
+size_t umm_free_heap_size_lw(void) {
+    return host_heap_free;
+}
+
+void umm_init_iram_ex(void *addr, unsigned int size, bool zero) {
+    (void)addr; (void)size; (void)zero;
+}
+
+};
@@ -0,0 +1,101 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Test double of the ESP8266 core for host builds of the library.
+
+  The target's DRAM and IRAM address ranges are mapped at the same addresses,
+  so the range checks in the library see what they would on the device. RTC
+  user memory is an array; each RTC write is recorded with the interrupt level
+  it ran at. Reboots are simulated by the tests: host_boot() sets resetInfo and
+  scrambles whatever would not survive that reset.
+*/
+#ifndef _HOST_CORE_H
+#define _HOST_CORE_H
+
+#include <Arduino.h>
+#include <user_interface.h>
+#include <cont.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+constexpr uintptr_t host_dram_start = 0x3FFE8000u;
+constexpr uintptr_t host_dram_end   = 0x40000000u;
+constexpr uintptr_t host_iram_start = 0x40100000u;
+constexpr uintptr_t host_iram_end   = 0x40108000u;
+
+struct HostRtcWrite {
+    uint32_t addr;      // word
+    uint32_t size;      // bytes
+    uint32_t intlevel;
+};
+
+extern uint32_t host_rtc[192];
+extern std::vector<HostRtcWrite> host_rtc_writes;
+extern unsigned long host_millis;
+extern size_t host_heap_free;
+
+extern struct rst_info resetInfo;
+extern "C" uint32_t __crc_val;
+
+// Map the DRAM and IRAM ranges. Call first.
+void host_core_begin(void);
+
+// Memory in .noinit DRAM, scrambled with DRAM at a power-on or deep sleep.
+void host_noinit(void *p, size_t sz);
+
+// Set resetInfo for the reset reason and scramble what the reset loses.
+void host_boot(uint32_t reason);
+
+// Output of Serial, ets_printf() and umm_info_safe_printf_P(), cleared.
+std::string host_output(void);
+
+static inline uint32_t host_intlevel(void) {
+    return host_ps & 15u;
+}
+
+extern int host_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        host_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    unsigned long long _a = (unsigned long long)(a), _b = (unsigned long long)(b); \
+    if (_a != _b) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed, 0x%llx != 0x%llx\n", \
+            __FILE__, __LINE__, #a, #b, _a, _b); \
+        host_failures++; \
+    } \
+} while (0)
+
+#define CHECK_STR(haystack, needle) do { \
+    if (std::string::npos == std::string(haystack).find(needle)) { \
+        fprintf(stderr, "%s:%d: \"%s\" not found in:\n%s\n", __FILE__, __LINE__, \
+            std::string(needle).c_str(), std::string(haystack).c_str()); \
+        host_failures++; \
+    } \
+} while (0)
+
+static inline int host_result(const char *name) {
+    fprintf(stderr, "%s: %s\n", name, (host_failures) ? "FAILED" : "passed");
+    return (host_failures) ? 1 : 0;
+}
+
+#endif // _HOST_CORE_H
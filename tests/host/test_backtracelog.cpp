@@ -0,0 +1,611 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host test of BacktraceLog.cpp: log buffer init and retention across resets,
+  RTC backup, exception frame search, the divide by zero rewrite, the cont
+  stack continuation, the shadow stack backtrace, and both reports. The
+  unwinder is replaced by a script of PC:SP steps, backtrace.cpp has its own
+  test.
+
+  Built once per configuration, see Makefile.
+*/
+#include "host_core.h"
+#include <esp8266_undocumented.h>
+#include "backtrace.h"
+#include "BacktraceLog.h"
+#include <map>
+
+union BacktraceLogUnion;
+extern union BacktraceLogUnion *pBT;
+#if !DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER
+extern "C" union BacktraceLogUnion _pBT;
+#endif
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+struct BACKTRACE_SNAPSHOT;
+extern struct BACKTRACE_SNAPSHOT *pSnap;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Scripted unwinder
+//
+struct Step {
+    uintptr_t pc, sp;           // in
+    uintptr_t next_pc, next_sp; // out
+    int ret;
+    uintptr_t fn;               // out, function start when known
+};
+
+struct Call {
+    uintptr_t pc, sp, lr;
+};
+
+static std::vector<Step> script;
+static std::vector<Call> calls;
+static struct BACKTRACE_PC_SP start[4];
+static std::vector<struct BACKTRACE_PC_SP> shadow;  // innermost first
+
+static void script_chain(uintptr_t pc, uintptr_t sp, size_t levels) {
+    for (size_t i = 1; i < levels; i++) {
+        script.push_back({pc, sp, pc + 0x100, sp + 0x20, 1});
+        pc += 0x100;
+        sp += 0x20;
+    }
+    script.push_back({pc, sp, 0, sp, 0});
+}
+
+static void script_reset(void) {
+    script.clear();
+    calls.clear();
+    memset(start, 0, sizeof(start));
+    shadow.clear();
+}
+
+extern "C" {
+struct BACKTRACE_PC_SP xt_return_address_ex(int lvl) {
+    return start[lvl & 3];
+}
+
+int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp, const void **o_fn) {
+    calls.push_back({(uintptr_t)i_pc, (uintptr_t)i_sp, (uintptr_t)i_lr});
+    *o_fn = NULL;
+    for (const Step &s : script) {
+        if (s.pc == (uintptr_t)i_pc && s.sp == (uintptr_t)i_sp) {
+            *o_pc = (const void *)s.next_pc;
+            *o_sp = (const void *)s.next_sp;
+            *o_fn = (const void *)s.fn;
+            return s.ret;
+        }
+    }
+    *o_pc = NULL;
+    *o_sp = i_sp;
+    return 0;
+}
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW
+size_t backtraceLog_instrument_backtrace_ex(const void **pc, const void **sp, size_t max, size_t *mismatch) {
+    size_t n = 0;
+    for (; n < shadow.size() && n < max; n++) {
+        pc[n] = shadow[n].pc;
+        if (sp) sp[n] = shadow[n].sp;
+    }
+    if (mismatch) *mismatch = 0;
+    return n;
+}
+#endif
+
+int xt_pc_is_valid(const void *pc) {
+    uintptr_t a = (uintptr_t)pc;
+    return (a >= 0x40100000u && a < 0x40108000u) || (a >= 0x40201010u && a < 0x40300000u);
+}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+//
+BacktraceLog backtraceLog;
+
+static void boot(uint32_t reason) {
+    host_boot(reason);
+    pBT = NULL;       // .bss, zero at every boot
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+    pSnap = NULL;
+#endif
+    preinit();
+    script_reset();
+}
+
+static struct BACKTRACE_LOG get_log(void) {
+    struct BACKTRACE_LOG log;
+    memset(&log, 0, sizeof(log));
+    CHECK_EQ(backtraceLog.read(&log), sizeof(log));
+    return log;
+}
+
+static void check_pcs(const struct BACKTRACE_LOG &log, const std::vector<uintptr_t> &pcs) {
+    CHECK_EQ(log.count, pcs.size());
+    for (size_t i = 0; i < pcs.size() && i < log.count; i++) {
+        CHECK_EQ(log.pc[i], pcs[i]);
+    }
+}
+
+static void check_rtc_matches(void) {
+#if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+    struct BACKTRACE_LOG log = get_log();
+    size_t sz = offsetof(struct BACKTRACE_LOG, pc) + log.count * sizeof(log.pc[0]);
+    CHECK(0 == memcmp(&host_rtc[DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET], &log, sz));
+#endif
+}
+
+static struct __exception_frame *make_frame(uintptr_t at, uint32_t epc, uint32_t a0) {
+    struct __exception_frame *frame = (struct __exception_frame *)at;
+    memset(frame, 0, sizeof(*frame));
+    frame->epc = epc;
+    frame->a0 = a0;
+    return frame;
+}
+
+static struct rst_info exception(uint32_t exccause, uint32_t epc1) {
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_EXCEPTION_RST;
+    ri.exccause = exccause;
+    ri.epc1 = epc1;
+    return ri;
+}
+
+static constexpr uint32_t stack_end = 0x3FFFFFB0u;
+static constexpr uint32_t REASON_USER_SWEXCEPTION_RST = 254u;
+
+////////////////////////////////////////////////////////////////////////////////
+// Tests
+//
+static void test_power_on(void) {
+    boot(REASON_DEFAULT_RST);
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.bootCounter, 1);
+    CHECK_EQ(log.crashCount, 0);
+    CHECK_EQ(log.count, 0);
+    CHECK_EQ(log.max, DEBUG_ESP_BACKTRACELOG_MAX);
+    CHECK_EQ(backtraceLog.available(), 0);
+    check_rtc_matches();
+
+    backtraceLog.report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Boot Count: 1\r\n");
+    CHECK_STR(out, "Backtrace empty\r\n");
+#if DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER
+    CHECK_STR(out, "Config: IRAM log buffer");
+#else
+    CHECK_STR(out, "Config: DRAM log buffer w/RTC");
+#endif
+}
+
+// abort() and panic() have no exception frame, unwind from the callback's caller.
+static void test_soft_crash(void) {
+    start[3] = {(const void *)0x40201010, (const void *)0x3FFFFE00};
+    script_chain(0x40201010, 0x3FFFFE00, 3);
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40201010, 0x40201110, 0x40201210});
+    CHECK_EQ(log.crashCount, 1);
+    CHECK_EQ(log.binCrc, __crc_val);
+    CHECK_EQ(log.rst_info.reason, REASON_USER_SWEXCEPTION_RST);
+    CHECK_EQ(calls.size(), 3);
+    check_rtc_matches();
+#if DEBUG_ESP_BACKTRACELOG_SHOW
+    CHECK_STR(host_output(), "Backtrace: 0x40201010:0x3ffffe00");
+#endif
+    host_output();
+}
+
+static void test_restart_keeps_log(void) {
+    boot(REASON_SOFT_RESTART);
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.bootCounter, 2);
+    CHECK_EQ(log.crashCount, 1);
+    check_pcs(log, {0x40201010, 0x40201110, 0x40201210});
+
+    uint32_t p[2];
+    CHECK_EQ(backtraceLog.read(p, 2), 2);
+    CHECK_EQ(p[0], 0x40201010u);
+    CHECK_EQ(p[1], 0x40201110u);
+
+    backtraceLog.report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Boot Count: 2\r\n");
+    CHECK_STR(out, "Crash count: 1\r\n");
+    CHECK_STR(out, "Reset Reason: 254\r\n");
+    CHECK_STR(out, "Build CRC: 0x1234ABCD\r\n");
+    CHECK_STR(out, "  Backtrace: 0x40201010 0x40201110 0x40201210\r\n");
+    CHECK(std::string::npos == out.find("does not match"));
+    CHECK(std::string::npos == out.find("Exception ("));
+
+    __crc_val = 0x55AA55AAu;
+    backtraceLog_report(NULL);
+    out = host_output();
+    CHECK_STR(out, "Current '.bin' CRC, 0x55AA55AA, does not match Backtrace's, 0x1234ABCD\r\n");
+    CHECK_STR(out, "  Backtrace: 0x40201010 0x40201110 0x40201210\r\n");
+    __crc_val = 0x1234ABCDu;
+}
+
+// Frame where postmortem's stack argument says, and off by the slack.
+static void test_exception_frame(uint32_t drift) {
+    boot(REASON_EXCEPTION_RST);
+    const uint32_t stack = 0x3FFFFC00u;
+    make_frame(stack - 256u, 0x40204040u, 0x40205050u);
+    script.push_back({0x40204040u, stack, 0x40205050u, stack + 0x20, 1});
+    script.push_back({0x40205050u, stack + 0x20, 0, stack + 0x20, 0});
+    if (drift) {
+        // A stale frame where the tally lands, its epc does not match
+        make_frame(stack + drift - 256u, 0x40209999u, 0x40208888u);
+    }
+    struct rst_info ri = exception(28, 0x40204040u);
+    ri.excvaddr = 0x10;
+    custom_crash_callback(&ri, stack + drift, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40204040u, 0x40205050u});
+    CHECK_EQ(log.rst_info.exccause, 28);
+    CHECK_EQ(log.rst_info.excvaddr, 0x10);
+    CHECK(calls.size() >= 1);
+    if (calls.size() >= 2) {
+        CHECK_EQ(calls[0].lr, 0x40205050u);     // a0 from the frame, for a leaf function
+        CHECK_EQ(calls[1].lr, 0);
+    }
+    check_rtc_matches();
+    host_output();
+
+    backtraceLog.report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Exception (28):\r\n  epc1=0x40204040 epc2=0x00000000 epc3=0x00000000 excvaddr=0x00000010 depc=0x00000000\r\n");
+}
+
+// Stack argument unusable, the unwinder backs up to the exception frame.
+static void test_exception_frame_by_unwind(void) {
+    boot(REASON_EXCEPTION_RST);
+    const uint32_t frame = 0x3FFFFB00u;
+    make_frame(frame, 0x40204040u, 0x40205050u);
+    start[0] = {(const void *)0x40100100, (const void *)0x3FFFF900};
+    script.push_back({0x40100100u, 0x3FFFF900u, 0x40100200u, 0x3FFFFA00u, 1});
+    script.push_back({0x40100200u, 0x3FFFFA00u, 0x4000050cu, frame, 0});
+    script.push_back({0x40204040u, frame + 256u, 0, frame + 256u, 0});
+    struct rst_info ri = exception(3, 0x40204040u);
+    custom_crash_callback(&ri, 0, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40204040u});
+    CHECK_EQ(calls.size(), 3);
+    if (3 == calls.size()) {
+        CHECK_EQ(calls[2].sp, frame + 256u);
+        CHECK_EQ(calls[2].lr, 0x40205050u);
+    }
+    host_output();
+}
+
+static void test_divide_by_zero(void) {
+    boot(REASON_EXCEPTION_RST);
+    const uint32_t stack = 0x3FFFFC00u;
+    make_frame(stack - 256u, 0x4000dce5u, 0x40206060u);
+    script.push_back({0x40206060u, stack, 0x40206160u, stack + 0x10, 1});
+    script.push_back({0x40206160u, stack + 0x10, 0, stack + 0x10, 0});
+    struct rst_info ri = exception(0, 0x4000dce5u);
+    custom_crash_callback(&ri, stack, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40206060u, 0x40206160u});
+    CHECK_EQ(log.rst_info.exccause, 6);
+    CHECK_EQ(log.rst_info.epc1, 0x40206060u);
+    if (calls.size()) {
+        CHECK_EQ(calls[0].lr, 0);
+    }
+    check_rtc_matches();
+    host_output();
+}
+
+// A bad epc is likely the cause, a0 is the better place to start.
+static void test_invalid_epc(void) {
+    boot(REASON_EXCEPTION_RST);
+    const uint32_t stack = 0x3FFFFC00u;
+    make_frame(stack - 256u, 0x3FFE0000u, 0x40207070u);
+    script.push_back({0x40207070u, stack, 0, stack, 0});
+    struct rst_info ri = exception(20, 0x3FFE0000u);
+    custom_crash_callback(&ri, stack, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40207070u});
+    if (calls.size()) {
+        CHECK_EQ(calls[0].lr, 0);
+    }
+    host_output();
+}
+
+// Crash on the SYS stack while loop() is yielded, continue on the cont stack.
+static void test_cont_suspended(void) {
+    boot(REASON_SOFT_RESTART);
+    start[3] = {(const void *)0x40201010, (const void *)0x3FFFFE00};
+    script_chain(0x40201010, 0x3FFFFE00, 2);
+    // 8 byte aligned, the host reads a0 as a 64 bit pointer
+    const uintptr_t sp_suspend = ((uintptr_t)&g_pcont->stack[CONT_STACKSIZE / 4 - 64] + 7u) & ~(uintptr_t)7u;
+    g_pcont->pc_suspend = (void (*)(void))0x40100a00;
+    g_pcont->sp_suspend = (unsigned *)sp_suspend;
+    *(const void **)(sp_suspend + 16u) = (const void *)0x40208000;
+    script_chain(0x40208000, sp_suspend + 24u, 2);
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    check_pcs(log, {0x40201010, 0x40201110, 0, 0x40208000, 0x40208100});
+    check_rtc_matches();
+    host_output();
+}
+
+// A backtrace longer than the log is cut at max.
+static void test_overflow(void) {
+    boot(REASON_SOFT_RESTART);
+    start[3] = {(const void *)0x40210000, (const void *)0x3FFFF000};
+    script_chain(0x40210000, 0x3FFFF000, DEBUG_ESP_BACKTRACELOG_MAX + 8);
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.count, log.max);
+    CHECK_EQ(log.pc[log.max - 1], 0x40210000u + 0x100u * (log.max - 1));
+    CHECK_EQ(calls.size(), DEBUG_ESP_BACKTRACELOG_MAX + 8);
+    check_rtc_matches();
+    host_output();
+}
+
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW
+static struct BACKTRACE_LOG shadow_crash(uintptr_t pc, uintptr_t sp) {
+    g_pcont->pc_suspend = NULL;
+    start[3] = {(const void *)pc, (const void *)sp};
+    shadow = {{(const void *)0x40202010, (const void *)0x3FFFFE00},
+              {(const void *)0x40203010, (const void *)0x3FFFFE20}};
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+    host_output();
+    return get_log();
+}
+
+// The crashing function's own shadow level is not logged twice.
+static void test_shadow(void) {
+    // In the innermost instrumented function, at its SP
+    boot(REASON_SOFT_RESTART);
+    check_pcs(shadow_crash(0x40202040, 0x3FFFFE00), {0x40202040, 0x40203010});
+
+    // Same function below its SP, the unwinder finds the same frame
+    boot(REASON_SOFT_RESTART);
+    script.push_back({0x40202040, 0x3FFFFDF0, 0x40203010, 0x3FFFFE20, 1, 0x40202000});
+    script.push_back({0x40202010, 0x3FFFFE00, 0x40203010, 0x3FFFFE20, 1, 0x40202000});
+    check_pcs(shadow_crash(0x40202040, 0x3FFFFDF0), {0x40202040, 0x40203010});
+
+    // In an uninstrumented leaf, the level is its caller
+    boot(REASON_SOFT_RESTART);
+    script.push_back({0x40205000, 0x3FFFFDE0, 0x40202010, 0x3FFFFE00, 1, 0x40204ff0});
+    script.push_back({0x40202010, 0x3FFFFE00, 0x40203010, 0x3FFFFE20, 1, 0x40202000});
+    check_pcs(shadow_crash(0x40205000, 0x3FFFFDE0), {0x40205000, 0x40202010, 0x40203010});
+
+    // A recursive call to the same function, before its hook ran
+    boot(REASON_SOFT_RESTART);
+    script.push_back({0x40202004, 0x3FFFFDE0, 0x40202030, 0x3FFFFE00, 1, 0x40202000});
+    script.push_back({0x40202010, 0x3FFFFE00, 0x40203010, 0x3FFFFE20, 1, 0x40202000});
+    check_pcs(shadow_crash(0x40202004, 0x3FFFFDE0), {0x40202004, 0x40202010, 0x40203010});
+
+    // Nothing tracked, the unwinder is used
+    boot(REASON_SOFT_RESTART);
+    script_chain(0x40201010, 0x3FFFFE00, 2);
+    start[3] = {(const void *)0x40201010, (const void *)0x3FFFFE00};
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+    check_pcs(get_log(), {0x40201010, 0x40201110});
+    host_output();
+}
+#endif
+
+static void test_clear(void) {
+    struct BACKTRACE_LOG before = get_log();
+    CHECK(before.count > 0);
+    backtraceLog.clear(Serial);
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.count, 0);
+    CHECK_EQ(log.crashCount, 0);
+    CHECK_EQ(log.bootCounter, before.bootCounter);
+    check_rtc_matches();
+
+
+    boot(REASON_SOFT_RESTART);
+    log = get_log();
+    CHECK_EQ(log.count, 0);
+    CHECK_EQ(log.crashCount, 0);
+}
+
+#if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+// Deep sleep loses DRAM, the log comes back from RTC memory.
+static void test_rtc_restore(void) {
+    boot(REASON_SOFT_RESTART);
+    start[3] = {(const void *)0x40201010, (const void *)0x3FFFFE00};
+    script_chain(0x40201010, 0x3FFFFE00, 3);
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+    struct BACKTRACE_LOG before = get_log();
+
+    boot(REASON_DEEP_SLEEP_AWAKE);
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.bootCounter, before.bootCounter + 1);
+    CHECK_EQ(log.crashCount, before.crashCount);
+    check_pcs(log, {0x40201010, 0x40201110, 0x40201210});
+    check_rtc_matches();
+
+    // A damaged RTC copy is dropped
+    host_rtc[DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET + offsetof(struct BACKTRACE_LOG, binCrc) / 4] ^= 0x100u;
+    boot(REASON_DEEP_SLEEP_AWAKE);
+    log = get_log();
+    CHECK_EQ(log.bootCounter, 1);
+    CHECK_EQ(log.crashCount, 0);
+    CHECK_EQ(log.count, 0);
+    check_rtc_matches();
+}
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+static void test_sys_state(void) {
+    boot(REASON_SOFT_RESTART);
+    host_millis = 123456;
+    host_heap_free = 30000;
+    for (size_t i = 0; i < CONT_STACKSIZE / 4 / 2; i++) {
+        g_pcont->stack[i] = 0xfeefeffeu;
+    }
+    start[3] = {(const void *)0x40201010, (const void *)0x3FFFFE00};
+    script_chain(0x40201010, 0x3FFFFE00, 1);
+    struct rst_info ri;
+    memset(&ri, 0, sizeof(ri));
+    ri.reason = REASON_USER_SWEXCEPTION_RST;
+    custom_crash_callback(&ri, 0x3FFFFD00, stack_end);
+
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.sys.uptime, 123456);
+    CHECK_EQ(log.sys.heapFree, 30000);
+    CHECK_EQ(log.sys.contStackFree, CONT_STACKSIZE / 2);
+    host_output();
+
+    backtraceLog.report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Heap free: 30000\r\n");
+    CHECK_STR(out, "Cont stack free: 2048, Uptime: 123456 ms\r\n");
+}
+#endif
+
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+// Parse the report's stack dump back into address:value pairs.
+static std::map<uint32_t, uint32_t> parse_snapshot(const std::string &out) {
+    std::map<uint32_t, uint32_t> words;
+    size_t pos = out.find(">>>stack>>>\r\n");
+    size_t end = out.find("<<<stack<<<");
+    if (std::string::npos == pos || std::string::npos == end) return words;
+    pos += 13;
+    while (pos < end) {
+        size_t eol = out.find("\r\n", pos);
+        std::string line = out.substr(pos, eol - pos);
+        unsigned addr;
+        int used;
+        if (1 == sscanf(line.c_str(), "%x: %n", &addr, &used)) {
+            const char *p = line.c_str() + used;
+            unsigned val;
+            int n;
+            while (1 == sscanf(p, " %x%n", &val, &n)) {
+                words[addr] = val;
+                addr += 4;
+                p += n;
+            }
+        }
+        pos = eol + 2;
+    }
+    return words;
+}
+
+static void test_snapshot(void) {
+    boot(REASON_EXCEPTION_RST);
+    const uint32_t stack = 0x3FFFFC00u;
+    // Runs of zeros and values, through the frame and the first window
+    uint32_t *w = (uint32_t *)(uintptr_t)(stack - 256u);
+    for (size_t i = 0; i < 128; i++) {
+        w[i] = (i % 7 < 3) ? 0 : 0xA5000000u + i;
+    }
+    make_frame(stack - 256u, 0x40204040u, 0x40205050u);
+    script.push_back({0x40204040u, stack, 0x40205050u, stack + 0x20, 1});
+    script.push_back({0x40205050u, stack + 0x20, 0, stack + 0x20, 0});
+    struct rst_info ri = exception(28, 0x40204040u);
+    custom_crash_callback(&ri, stack, stack_end);
+    host_output();
+
+    backtraceLog.report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Stack snapshot: ");
+    std::map<uint32_t, uint32_t> words = parse_snapshot(out);
+    // The frame, then each SP's window; overlap is saved once.
+    const uint32_t first = stack - 256u;
+    const uint32_t last = stack + 0x20 + DEBUG_ESP_BACKTRACELOG_STACK_WINDOW;
+    for (uint32_t a = first; a < first + sizeof(struct __exception_frame); a += 4) {
+        CHECK(words.count(a));
+    }
+    for (uint32_t a = stack; a < last; a += 4) {
+        CHECK(words.count(a));
+    }
+    for (auto &kv : words) {
+        CHECK_EQ(kv.second, *(uint32_t *)(uintptr_t)kv.first);
+    }
+
+    // A snapshot from another crash is not shown
+    backtraceLog_clear();
+    backtraceLog_report(NULL);
+    out = host_output();
+    CHECK(std::string::npos == out.find("Stack snapshot"));
+}
+#endif
+
+int main() {
+    host_core_begin();
+    __crc_val = 0x1234ABCDu;
+#if !DEBUG_ESP_BACKTRACELOG_USE_IRAM_BUFFER
+    host_noinit(&_pBT, sizeof(struct BACKTRACE_LOG));
+#endif
+
+    test_power_on();
+    test_soft_crash();
+    test_restart_keeps_log();
+    test_exception_frame(0);
+    test_exception_frame(32);
+    test_exception_frame_by_unwind();
+    test_divide_by_zero();
+    test_invalid_epc();
+    test_cont_suspended();
+    test_overflow();
+#if DEBUG_ESP_BACKTRACELOG_INSTRUMENT_SHADOW
+    test_shadow();
+#endif
+    test_clear();
+#if DEBUG_ESP_BACKTRACELOG_USE_RTC_BUFFER_OFFSET
+    test_rtc_restore();
+#endif
+#if DEBUG_ESP_BACKTRACELOG_SYS_STATE
+    test_sys_state();
+#endif
+#if DEBUG_ESP_BACKTRACELOG_STACK_SNAPSHOT
+    test_snapshot();
+#endif
+
+    // Power-on after all that starts clean
+    boot(REASON_DEFAULT_RST);
+    struct BACKTRACE_LOG log = get_log();
+    CHECK_EQ(log.bootCounter, 1);
+    CHECK_EQ(log.count, 0);
+
+    return host_result(TEST_NAME);
+}
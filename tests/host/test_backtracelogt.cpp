@@ -0,0 +1,256 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host test of BacktraceLogT.h.
+
+  Several configurations are instantiated: DRAM and RTC storage, ring and
+  first record policies. The RTC copy must match DRAM after every call, and be
+  written with interrupts disabled. record() walks a scripted unwinder.
+
+  Built with -DSTATIC_ASSERT_CASE=n, one bad configuration is instantiated
+  instead; the Makefile checks each fails to compile on its static_assert.
+*/
+#if STATIC_ASSERT_CASE == 5
+// Crash log records that leave no room for 4 PCs in RTC memory after word 96
+#define DEBUG_ESP_BACKTRACELOG_IRQ_TRACE 8
+#define DEBUG_ESP_BACKTRACELOG_SWDT_ASSIST 16
+#endif
+#include "host_core.h"
+#include <BacktraceLogT.h>
+
+#if STATIC_ASSERT_CASE == 1
+BacktraceLogT<3> tooShort;                                      // Depth >= 4
+#elif STATIC_ASSERT_CASE == 2
+BacktraceLogT<64, BacktraceStorageRtc<160>> tooLong;            // Fits storage
+#elif STATIC_ASSERT_CASE == 3
+BacktraceLogT<4, BacktraceStorageRtc<192>> outOfRange;          // Offset 64 - 192
+#elif STATIC_ASSERT_CASE == 4
+BacktraceLogT<4, BacktraceStorageRtc<100>> overlapsCrashLog;    // Crash log at 96
+#elif STATIC_ASSERT_CASE == 5
+// Stopped in BacktraceLog.h
+#else
+
+#include <string.h>
+
+// Scripted unwinder: record() walks down this list, 16 bytes of stack a frame.
+static std::vector<const void *> script;
+
+extern "C" struct BACKTRACE_PC_SP xt_return_address_ex(int lvl) {
+    struct BACKTRACE_PC_SP pc_sp = {NULL, NULL};
+    if (lvl >= 0 && (size_t)lvl < script.size()) {
+        pc_sp.pc = script[lvl];
+        pc_sp.sp = (const void *)(uintptr_t)(0x3FFFF000u + 16u * lvl);
+    }
+    return pc_sp;
+}
+
+extern "C" int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp, const void **o_fn) {
+    (void)i_lr;
+    *o_fn = NULL;
+    for (size_t i = 0; i + 1u < script.size(); i++) {
+        if (script[i] == i_pc) {
+            *o_pc = script[i + 1u];
+            *o_sp = (const void *)((uintptr_t)i_sp + 16u);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef BacktraceLogT<4, BacktraceStorageDram, BacktraceRecordRing> DramRing;
+typedef BacktraceLogT<4, BacktraceStorageDram, BacktraceRecordFirst> DramFirst;
+typedef BacktraceLogT<16> DramTrace;
+typedef BacktraceLogT<8, BacktraceStorageRtc<160>, BacktraceRecordFirst> RtcFirst;
+typedef BacktraceLogT<4, BacktraceStorageRtc<180>, BacktraceRecordRing> RtcRing;
+
+static_assert(DramRing::key != DramFirst::key && DramRing::key != RtcRing::key &&
+    DramRing::key != DramTrace::key, "Layout keys must differ");
+
+static const void *pc(uintptr_t n) {
+    return (const void *)(0x40201000u + 16u * n);
+}
+
+template <typename T>
+static std::vector<const void *> contents(void) {
+    std::vector<const void *> v(T::available() + 1);
+    v.resize(T::read(v.data(), v.size()));
+    return v;
+}
+
+// The RTC copy, read back as the log's own layout
+template <typename T, size_t Offset>
+static typename T::LOG rtc_copy(void) {
+    typename T::LOG log;
+    memcpy(&log, &host_rtc[Offset], sizeof(log));
+    return log;
+}
+
+template <typename T, size_t Offset>
+static void check_rtc_matches(void) {
+    typename T::LOG log = rtc_copy<T, Offset>();
+    CHECK_EQ(log.magic, T::key);
+    CHECK_EQ(log.count, (uint32_t)T::available());
+    std::vector<const void *> v = contents<T>();
+    size_t start = (log.count == sizeof(log.pc) / sizeof(log.pc[0])) ? log.head : 0u;
+    for (size_t i = 0; i < v.size(); i++) {
+        CHECK(v[i] == log.pc[(start + i) % (sizeof(log.pc) / sizeof(log.pc[0]))]);
+    }
+}
+
+static void check_rtc_writes_locked(void) {
+    CHECK(!host_rtc_writes.empty());
+    for (const HostRtcWrite &w : host_rtc_writes) {
+        CHECK_EQ(w.intlevel, 15);
+    }
+    CHECK_EQ(host_intlevel(), 0);
+    host_rtc_writes.clear();
+}
+
+static void test_ring(void) {
+    DramRing::clear();
+    CHECK_EQ(DramRing::available(), 0);
+    for (uintptr_t n = 1; n <= 6; n++) DramRing::write(pc(n));
+    std::vector<const void *> expect = {pc(3), pc(4), pc(5), pc(6)};
+    CHECK(expect == contents<DramRing>());
+    CHECK_EQ(host_intlevel(), 0);
+
+    // Kept by begin(), the layout matches
+    DramRing::begin();
+    CHECK(expect == contents<DramRing>());
+
+    const void *p[2];
+    CHECK_EQ(DramRing::read(p, 2), 2);
+    CHECK(pc(3) == p[0] && pc(4) == p[1]);
+
+    DramRing::report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Config: DRAM log buffer:");
+    CHECK_STR(out, "Depth: 4, ring");
+    CHECK_STR(out, "Written: 6, held: 4");
+    CHECK_STR(out, "  Backtrace: 0x40201030 0x40201040 0x40201050 0x40201060\r\n");
+}
+
+static void test_first(void) {
+    DramFirst::clear();
+    for (uintptr_t n = 1; n <= 6; n++) DramFirst::write(pc(n));
+    std::vector<const void *> expect = {pc(1), pc(2), pc(3), pc(4)};
+    CHECK(expect == contents<DramFirst>());
+
+    DramFirst::report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Depth: 4, first");
+    CHECK_STR(out, "Written: 6, held: 4");
+
+    // A separate log from the ring of the same Depth
+    CHECK_EQ(DramRing::available(), 4);
+    CHECK(pc(3) == contents<DramRing>()[0]);
+}
+
+static void test_record(void) {
+    DramTrace::clear();
+    script = {pc(10), pc(11), pc(12), pc(13), pc(14)};
+    DramTrace::record(3);
+    DramTrace::record(10);
+    script.clear();
+    DramTrace::record(3);   // Nothing to unwind, just the NULL
+    std::vector<const void *> expect = {pc(10), pc(11), pc(12), NULL,
+        pc(10), pc(11), pc(12), pc(13), pc(14), NULL, NULL};
+    CHECK(expect == contents<DramTrace>());
+
+    DramTrace::report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Written: 11, held: 11");
+    CHECK_STR(out, "  Backtrace: 0x402010a0 0x402010b0 0x402010c0\r\n"
+                   "  Backtrace: 0x402010a0 0x402010b0 0x402010c0 0x402010d0 0x402010e0\r\n");
+}
+
+static void test_rtc_first(void) {
+    memset(host_rtc, 0, sizeof(host_rtc));
+    host_rtc_writes.clear();
+
+    // Nothing valid in RTC memory, begin() clears
+    RtcFirst::begin();
+    CHECK_EQ(RtcFirst::available(), 0);
+    check_rtc_matches<RtcFirst, 160>();
+    check_rtc_writes_locked();
+
+    for (uintptr_t n = 1; n <= 10; n++) {
+        RtcFirst::write(pc(n));
+        check_rtc_matches<RtcFirst, 160>();
+        check_rtc_writes_locked();
+    }
+    CHECK_EQ((rtc_copy<RtcFirst, 160>().total), 10);
+    CHECK_EQ(RtcFirst::available(), 8);
+
+    // Loaded from RTC memory, as after deep sleep
+    RtcFirst::LOG log = {};
+    log.magic = RtcFirst::key;
+    log.head = 3;
+    log.count = 3;
+    log.total = 7;
+    log.pc[0] = pc(20);
+    log.pc[1] = pc(21);
+    log.pc[2] = pc(22);
+    memcpy(&host_rtc[160], &log, sizeof(log));
+    RtcFirst::begin();
+    std::vector<const void *> expect = {pc(20), pc(21), pc(22)};
+    CHECK(expect == contents<RtcFirst>());
+    CHECK(host_rtc_writes.empty());
+
+    // A bad count is not trusted
+    log.count = 9;
+    memcpy(&host_rtc[160], &log, sizeof(log));
+    RtcFirst::begin();
+    CHECK_EQ(RtcFirst::available(), 0);
+    check_rtc_matches<RtcFirst, 160>();
+    check_rtc_writes_locked();
+}
+
+static void test_rtc_ring(void) {
+    host_rtc_writes.clear();
+    RtcRing::clear();
+    check_rtc_writes_locked();
+    for (uintptr_t n = 1; n <= 7; n++) {
+        RtcRing::write(pc(n));
+        check_rtc_matches<RtcRing, 180>();
+        check_rtc_writes_locked();
+    }
+    std::vector<const void *> expect = {pc(4), pc(5), pc(6), pc(7)};
+    CHECK(expect == contents<RtcRing>());
+
+    // Neither log writes outside its words
+    CHECK_EQ((rtc_copy<RtcFirst, 160>().magic), RtcFirst::key);
+    CHECK_EQ(RtcFirst::available(), 0);
+    RtcFirst::begin();
+    CHECK_EQ(RtcFirst::available(), 0);
+    RtcRing::begin();
+    CHECK(expect == contents<RtcRing>());
+
+    RtcRing::report(Serial);
+    CHECK_STR(host_output(), "Config: DRAM w/RTC log buffer:");
+}
+
+int main() {
+    host_core_begin();
+    test_ring();
+    test_first();
+    test_record();
+    test_rtc_first();
+    test_rtc_ring();
+    return host_result(TEST_NAME);
+}
+
+#endif // STATIC_ASSERT_CASE
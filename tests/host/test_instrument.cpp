@@ -0,0 +1,430 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host test of the -finstrument-functions hooks in BacktraceInstrument.cpp.
+
+  The C hooks are built here, BacktraceInstrument.cpp is included so the static
+  hwdt_profile_func_enter() can be called with chosen PC:SP values.
+
+  The DEBUG_ESP_BACKTRACELOG_INSTRUMENT_FAST hooks are asm. Their text is taken
+  from a preprocessed copy of BacktraceInstrument.cpp, see Makefile, and run by
+  a small interpreter for the few Xtensa instructions they use. Their memory is
+  a 32-bit image laid out as the static_asserts in BacktraceInstrument.cpp
+  require. Random enter/exit sequences are run through both, the image must
+  match the C structures after every call.
+*/
+#include "host_core.h"
+#include "../../src/BacktraceInstrument.cpp"
+#include <fstream>
+#include <sstream>
+#include <map>
+
+extern "C" int xt_retaddr_callee_ex(const void * const i_pc, const void * const i_sp, const void * const i_lr, const void **o_pc, const void **o_sp, const void **o_fn) {
+    // Each step is a 32 byte frame, PCs are not checked
+    (void)i_lr;
+    *o_pc = i_pc;
+    *o_sp = (const void *)((uintptr_t)i_sp + 32u);
+    *o_fn = NULL;
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The asm hooks
+//
+// Image of hwdt_last_call and hwdt_event_ring as the asm sees them
+struct Last32 {
+    uint32_t pc;
+    uint32_t sp;
+};
+struct StackLastPCPS32 {
+    int32_t level;
+    struct Last32 last[INSTRUMENT_STACK_SZ];
+};
+struct Event32 {
+    uint32_t fn;
+    uint32_t ccount;
+};
+struct EventRing32 {
+    uint32_t head;
+    struct Event32 event[DEBUG_ESP_BACKTRACELOG_EVENT_RING];
+};
+// As the asm, see the static_asserts in BacktraceInstrument.cpp
+static_assert(0 == offsetof(struct StackLastPCPS32, level), "asm offsets");
+static_assert(4 == offsetof(struct StackLastPCPS32, last), "asm offsets");
+static_assert(8 == sizeof(struct Last32), "asm uses addx8");
+static_assert(0 == offsetof(struct EventRing32, head), "asm offsets");
+static_assert(4 == offsetof(struct EventRing32, event), "asm offsets");
+static_assert(8 == sizeof(struct Event32), "asm uses addx8");
+
+constexpr uint32_t last_call_addr = 0x3FFEC000u;
+constexpr uint32_t event_ring_addr = 0x3FFED000u;
+
+static struct StackLastPCPS32 last_call32;
+static struct EventRing32 event_ring32;
+
+static uint32_t *mem32(uint32_t addr) {
+    if (addr & 3u) return NULL;
+    if (addr >= last_call_addr && addr < last_call_addr + sizeof(last_call32)) {
+        return (uint32_t *)((uint8_t *)&last_call32 + (addr - last_call_addr));
+    }
+    if (addr >= event_ring_addr && addr < event_ring_addr + sizeof(event_ring32)) {
+        return (uint32_t *)((uint8_t *)&event_ring32 + (addr - event_ring_addr));
+    }
+    return NULL;
+}
+
+struct Insn {
+    std::string op;
+    std::vector<std::string> arg;
+    std::string label;
+};
+
+static std::vector<Insn> text;
+
+static std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t");
+    size_t e = s.find_last_not_of(" \t");
+    return (std::string::npos == b) ? std::string() : s.substr(b, e - b + 1);
+}
+
+// String literals of the first top-level asm() after "INSTRUMENT_FAST" hooks.
+static std::string asm_from_preprocessed(const char *path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string src = ss.str();
+    size_t pos = src.find("__cyg_profile_func_enter:");
+    pos = src.rfind("asm", pos);
+    size_t end = src.find(");", pos);
+    std::string out;
+    if (std::string::npos == pos || std::string::npos == end) return out;
+    for (size_t i = pos; i < end; i++) {
+        if ('"' != src[i]) continue;
+        for (i++; i < end && '"' != src[i]; i++) {
+            char c = src[i];
+            if ('\\' == c) {
+                c = src[++i];
+                c = ('n' == c) ? '\n' : ('t' == c) ? '\t' : c;
+            }
+            out += c;
+        }
+    }
+    return out;
+}
+
+static void load_asm(const std::string &s) {
+    std::stringstream lines(s);
+    std::string line;
+    while (std::getline(lines, line)) {
+        line = trim(line);
+        if (line.empty() || '.' == line[0]) continue;
+        Insn insn;
+        if (':' == line.back()) {
+            insn.label = line.substr(0, line.size() - 1);
+            text.push_back(insn);
+            continue;
+        }
+        size_t sp = line.find_first_of(" \t");
+        insn.op = line.substr(0, sp);
+        if (std::string::npos != sp) {
+            std::stringstream args(line.substr(sp));
+            std::string a;
+            while (std::getline(args, a, ',')) insn.arg.push_back(trim(a));
+        }
+        text.push_back(insn);
+    }
+}
+
+struct Cpu {
+    uint32_t a[16];
+    uint32_t ccount;
+    bool fault;
+};
+
+static unsigned reg(Cpu &cpu, const std::string &r) {
+    if (r.size() < 2 || 'a' != r[0]) {
+        cpu.fault = true;
+        return 0;
+    }
+    return atoi(r.c_str() + 1) & 15;
+}
+
+static int32_t imm(Cpu &cpu, const std::string &s) {
+    if ("hwdt_last_call" == s) return last_call_addr;
+    if ("hwdt_event_ring" == s) return event_ring_addr;
+    // n or n - m
+    char *end;
+    long v = strtol(s.c_str(), &end, 0);
+    std::string rest = trim(end);
+    if (rest.size() > 1 && '-' == rest[0]) {
+        v -= strtol(rest.c_str() + 1, &end, 0);
+        rest = trim(end);
+    }
+    if (!rest.empty()) cpu.fault = true;
+    return (int32_t)v;
+}
+
+// Local labels, "1f" is the next "1:"
+static size_t branch_target(Cpu &cpu, size_t from, const std::string &l) {
+    if (l.size() < 2 || 'f' != l.back()) {
+        cpu.fault = true;
+        return text.size();
+    }
+    std::string name = l.substr(0, l.size() - 1);
+    for (size_t i = from + 1; i < text.size(); i++) {
+        if (text[i].label == name) return i;
+    }
+    cpu.fault = true;
+    return text.size();
+}
+
+static void run(Cpu &cpu, const char *entry) {
+    size_t pc = 0;
+    while (pc < text.size() && text[pc].label != entry) pc++;
+    for (int steps = 0; pc < text.size() && steps < 100 && !cpu.fault; steps++) {
+        const Insn &i = text[pc++];
+        const std::vector<std::string> &a = i.arg;
+        if (!i.label.empty()) continue;
+        if ("ret.n" == i.op) return;
+        if ("rsr.ccount" == i.op && 1 == a.size()) {
+            cpu.a[reg(cpu, a[0])] = cpu.ccount;
+        } else if ("movi" == i.op && 2 == a.size()) {
+            cpu.a[reg(cpu, a[0])] = imm(cpu, a[1]);
+        } else if (3 != a.size()) {
+            cpu.fault = true;
+        } else if ("l32i.n" == i.op || "s32i.n" == i.op) {
+            uint32_t *m = mem32(cpu.a[reg(cpu, a[1])] + imm(cpu, a[2]));
+            if (NULL == m) {
+                cpu.fault = true;
+            } else if ('l' == i.op[0]) {
+                cpu.a[reg(cpu, a[0])] = *m;
+            } else {
+                *m = cpu.a[reg(cpu, a[0])];
+            }
+        } else if ("addi.n" == i.op || "addi" == i.op) {
+            cpu.a[reg(cpu, a[0])] = cpu.a[reg(cpu, a[1])] + imm(cpu, a[2]);
+        } else if ("addx8" == i.op) {
+            cpu.a[reg(cpu, a[0])] = (cpu.a[reg(cpu, a[1])] << 3) + cpu.a[reg(cpu, a[2])];
+        } else if ("and" == i.op) {
+            cpu.a[reg(cpu, a[0])] = cpu.a[reg(cpu, a[1])] & cpu.a[reg(cpu, a[2])];
+        } else if ("bgeu" == i.op) {
+            if (cpu.a[reg(cpu, a[0])] >= cpu.a[reg(cpu, a[1])]) pc = branch_target(cpu, pc - 1, a[2]);
+        } else if ("blti" == i.op) {
+            if ((int32_t)cpu.a[reg(cpu, a[0])] < imm(cpu, a[1])) pc = branch_target(cpu, pc - 1, a[2]);
+        } else {
+            fprintf(stderr, "asm: unknown instruction %s\n", i.op.c_str());
+            cpu.fault = true;
+        }
+    }
+    cpu.fault = true;   // No ret.n
+}
+
+static bool asm_call(const char *entry, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t ccount) {
+    Cpu cpu;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu.a[0] = a0;
+    cpu.a[1] = a1;
+    cpu.a[2] = a2;
+    cpu.ccount = ccount;
+    run(cpu, entry);
+    // Only the caller saved a4 - a7 may be changed, and a2 on exit
+    return !cpu.fault && a0 == cpu.a[0] && a1 == cpu.a[1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// C hooks
+//
+static void c_enter(uint32_t pc, uint32_t sp, uint32_t fn, uint32_t ccount) {
+    host_ccount = ccount;
+    hwdt_profile_func_enter((void *)(uintptr_t)pc, (void *)(uintptr_t)sp, (void *)(uintptr_t)fn);
+}
+
+static void c_exit(uint32_t fn, uint32_t ccount) {
+    host_ccount = ccount;
+    __cyg_profile_func_exit((void *)(uintptr_t)fn, NULL);
+}
+
+static void reset(ssize_t level) {
+    memset(&hwdt_last_call, 0, sizeof(hwdt_last_call));
+    memset(&hwdt_event_ring, 0, sizeof(hwdt_event_ring));
+    memset(&last_call32, 0, sizeof(last_call32));
+    memset(&event_ring32, 0, sizeof(event_ring32));
+    hwdt_last_call.level = level;
+    last_call32.level = (int32_t)level;
+}
+
+static bool same(void) {
+    bool ok = hwdt_last_call.level == last_call32.level;
+    for (size_t i = 0; i < INSTRUMENT_STACK_SZ; i++) {
+        ok = ok && (uintptr_t)hwdt_last_call.last[i].pc == last_call32.last[i].pc;
+        ok = ok && (uintptr_t)hwdt_last_call.last[i].sp == last_call32.last[i].sp;
+    }
+    ok = ok && hwdt_event_ring.head == event_ring32.head;
+    for (size_t i = 0; i < DEBUG_ESP_BACKTRACELOG_EVENT_RING; i++) {
+        ok = ok && hwdt_event_ring.event[i].fn == event_ring32.event[i].fn;
+        ok = ok && hwdt_event_ring.event[i].ccount == event_ring32.event[i].ccount;
+    }
+    return ok;
+}
+
+static uint32_t rnd = 0x1234567u;
+static uint32_t next_rnd(void) {
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tests
+//
+static void test_enter_exit(void) {
+    reset(0);
+    c_enter(0x40201004, 0x3FFFFF00, 0x40201000, 100);
+    c_enter(0x40202008, 0x3FFFFEE0, 0x40202000, 200);
+    c_enter(0x4020300c, 0x3FFFFEC0, 0x40203000, 300);
+    CHECK_EQ(hwdt_last_call.level, 3);
+    CHECK_EQ(hwdt_last_call.last[0].pc, 0x40201004);
+    CHECK_EQ(hwdt_last_call.last[0].sp, 0x3FFFFF00);
+    CHECK_EQ(hwdt_last_call.last[2].pc, 0x4020300c);
+    CHECK_EQ(hwdt_last_call.last[2].sp, 0x3FFFFEC0);
+
+    const void *pc[8], *sp[8];
+    size_t mismatch = 99;
+    CHECK_EQ(backtraceLog_instrument_backtrace_ex(pc, sp, 8, &mismatch), 3);
+    CHECK_EQ(pc[0], 0x4020300c);    // Innermost first
+    CHECK_EQ(sp[0], 0x3FFFFEC0);
+    CHECK_EQ(pc[2], 0x40201004);
+    CHECK_EQ(mismatch, 0);          // Each level 32 bytes below its caller
+    CHECK_EQ(backtraceLog_instrument_backtrace(pc, 2, NULL), 2);
+
+    c_exit(0x40203000, 400);
+    CHECK_EQ(hwdt_last_call.level, 2);
+    CHECK_EQ(hwdt_event_ring.head, 4);
+    CHECK_EQ(hwdt_event_ring.event[2].fn, 0x40203000);
+    CHECK_EQ(hwdt_event_ring.event[3].fn, 0x40203001);  // Exit, bit 0
+    CHECK_EQ(hwdt_event_ring.event[3].ccount, 400);
+
+    // A frame that is not 32 bytes below its caller
+    c_enter(0x40204010, 0x3FFFFE00, 0x40204000, 500);
+    CHECK_EQ(backtraceLog_instrument_backtrace_ex(pc, NULL, 8, &mismatch), 3);
+    CHECK_EQ(mismatch, 1);
+}
+
+// Deeper than the PC:SP stack, the level is still tracked and comes back down.
+static void test_saturation(void) {
+    reset(0);
+    const size_t depth = INSTRUMENT_STACK_SZ + 12;
+    for (size_t i = 0; i < depth; i++) {
+        c_enter(0x40210000 + 4 * i, 0x3FFFF000 - 16 * i, 0x40220000 + 16 * i, i);
+    }
+    CHECK_EQ(hwdt_last_call.level, depth);
+    CHECK_EQ(hwdt_last_call.last[INSTRUMENT_STACK_SZ - 1].pc, 0x40210000 + 4 * (INSTRUMENT_STACK_SZ - 1));
+
+    const void *pc[INSTRUMENT_STACK_SZ + 4];
+    CHECK_EQ(backtraceLog_instrument_backtrace(pc, INSTRUMENT_STACK_SZ + 4, NULL), INSTRUMENT_STACK_SZ);
+
+    for (size_t i = 0; i < depth + 3; i++) {
+        c_exit(0x40220000, i);
+    }
+    CHECK_EQ(hwdt_last_call.level, 0);    // Stops at 0
+    CHECK_EQ(hwdt_event_ring.head, 2 * depth + 3);
+    CHECK_EQ(backtraceLog_instrument_backtrace(pc, 4, NULL), 0);
+
+    // Out of range levels are left alone
+    reset(-5);
+    c_enter(0x40201004, 0x3FFFFF00, 0x40201000, 1);
+    CHECK_EQ(hwdt_last_call.level, -4);
+    CHECK_EQ(hwdt_last_call.last[0].pc, 0);
+    c_exit(0x40201000, 2);
+    CHECK_EQ(hwdt_last_call.level, -4);
+    CHECK_EQ(backtraceLog_instrument_backtrace(pc, 4, NULL), 0);
+}
+
+// The stack low-water chain, within and deeper than the PC:SP stack.
+static void test_stack_low_water(void) {
+    reset(0);
+    instrument_stack.magic = ~stack_magic;   // Leftover noinit contents
+    instrument_stack.low[INSTRUMENT_STACK_SYS].depth = 0xFFFFu;
+    c_enter(0x40201004, 0x3FFFFF00, 0x40201000, 1);
+    CHECK_EQ(instrument_stack.magic, stack_magic);
+    c_enter(0x40202008, 0x3FFFFEE0, 0x40202000, 2);
+    struct InstrumentStackLow *low = &instrument_stack.low[INSTRUMENT_STACK_SYS];
+    CHECK_EQ(low->depth, 0x120);
+    CHECK_EQ(low->count, 2);
+    CHECK_EQ(low->skipped, 0);
+    CHECK_EQ(low->pc[0], 0x40202008);
+    CHECK_EQ(low->pc[1], 0x40201004);
+
+    // The new low is past the tracked levels, it still leads the chain
+    const size_t depth = INSTRUMENT_STACK_SZ + 5;
+    for (size_t i = 2; i < depth; i++) {
+        c_enter(0x40210000 + 4 * i, 0x3FFFFEE0 - 16 * i, 0x40220000 + 16 * i, i);
+    }
+    CHECK_EQ(low->depth, 0x120 + 16 * (depth - 1));
+    CHECK_EQ(low->count, stack_chain_sz);
+    CHECK_EQ(low->skipped, depth - 1 - INSTRUMENT_STACK_SZ);
+    CHECK_EQ(low->pc[0], 0x40210000 + 4 * (depth - 1));
+    CHECK_EQ(low->pc[1], 0x40210000 + 4 * (INSTRUMENT_STACK_SZ - 1));
+
+    backtraceLog_instrument_stack_report(Serial);
+    std::string out = host_output();
+    CHECK_STR(out, "Stack high-water sys: ");
+    CHECK_STR(out, "  Untracked levels after the first: 4\r\n");
+    backtraceLog_instrument_stack_clear();
+}
+
+static void test_fast_asm(void) {
+    std::string s = asm_from_preprocessed(INSTRUMENT_FAST_II);
+    load_asm(s);
+    CHECK(text.size() > 10);
+    if (text.size() <= 10) return;
+
+    static const ssize_t start_level[] = {0, 0, 45, -3};
+    for (ssize_t level : start_level) {
+        reset(level);
+        bool ok = true;
+        for (uint32_t n = 0; n < 3000 && ok; n++) {
+            uint32_t r = next_rnd();
+            uint32_t fn = 0x40200000u + (r & 0xFFF0u);
+            uint32_t ccount = next_rnd();
+            // Mostly balanced, with runs deep past the PC:SP stack
+            if ((r >> 20) % 100 < ((n / 500) & 1 ? 70u : 45u)) {
+                uint32_t pc = fn + 3u + ((r >> 16) & 0xF);
+                uint32_t sp = 0x3FFF0000u + ((r >> 4) & 0xFFF0u);
+                c_enter(pc, sp, fn, ccount);
+                ok = asm_call("__cyg_profile_func_enter", pc, sp, fn, ccount);
+            } else {
+                c_exit(fn, ccount);
+                ok = asm_call("__cyg_profile_func_exit", 0x40100000u, 0x3FFFF000u, fn, ccount);
+            }
+            if (!ok) {
+                fprintf(stderr, "asm: fault, n=%u\n", n);
+            }
+            ok = ok && same();
+        }
+        CHECK(ok);
+    }
+}
+
+int main() {
+    host_core_begin();
+    test_enter_exit();
+    test_saturation();
+    test_stack_low_water();
+    test_fast_asm();
+    return host_result(TEST_NAME);
+}
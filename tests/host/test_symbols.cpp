@@ -0,0 +1,221 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host test of backtraceLog_symbol() in BacktraceSymbols.cpp.
+
+  The test is linked at 0x40200000, in the range scripts/embed_symbols.sh
+  takes functions from, and the script fills in the table in the linked
+  binary, see Makefile. Each function in the table is then looked up with
+  backtraceLog_symbol() and with the script's own reader, "embed_symbols.sh
+  -l". The two must agree, over every restart boundary.
+*/
+#include "host_core.h"
+#include "BacktraceSymbols.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+extern "C" const uint32_t backtraceLog_symbols[DEBUG_ESP_BACKTRACELOG_SYMBOLS / sizeof(uint32_t)];
+
+// Functions with known names, more than two restart intervals of shared prefixes
+#define SYMTEST_FN(n) \
+    extern "C" __attribute__((noinline, used)) int symtest_fn_##n(int x) { return x * 1##n + 1; }
+SYMTEST_FN(00) SYMTEST_FN(01) SYMTEST_FN(02) SYMTEST_FN(03) SYMTEST_FN(04)
+SYMTEST_FN(05) SYMTEST_FN(06) SYMTEST_FN(07) SYMTEST_FN(08) SYMTEST_FN(09)
+SYMTEST_FN(10) SYMTEST_FN(11) SYMTEST_FN(12) SYMTEST_FN(13) SYMTEST_FN(14)
+SYMTEST_FN(15) SYMTEST_FN(16) SYMTEST_FN(17) SYMTEST_FN(18) SYMTEST_FN(19)
+SYMTEST_FN(20) SYMTEST_FN(21) SYMTEST_FN(22) SYMTEST_FN(23) SYMTEST_FN(24)
+SYMTEST_FN(25) SYMTEST_FN(26) SYMTEST_FN(27) SYMTEST_FN(28) SYMTEST_FN(29)
+SYMTEST_FN(30) SYMTEST_FN(31) SYMTEST_FN(32) SYMTEST_FN(33) SYMTEST_FN(34)
+
+namespace symtest {
+struct Widget {
+    __attribute__((noinline, used)) int overloaded(int x) { return x + 2; }
+    __attribute__((noinline, used)) int overloaded(const char *s) { return s[0]; }
+};
+}
+
+// 120 characters, longer than the 64 the reports use
+extern "C" __attribute__((noinline, used)) int symtest_a_very_long_function_name_to_check_that_the_lookup_truncates_names_to_the_buffer_size_it_is_given_ok(int x) {
+    return x - 3;
+}
+static const char long_name[] = "symtest_a_very_long_function_name_to_check_that_the_lookup_truncates_names_to_the_buffer_size_it_is_given_ok";
+
+static uint32_t table(size_t i) {
+    return backtraceLog_symbols[i];
+}
+
+static size_t table_count(void) {
+    return table(1);
+}
+
+static uint32_t table_addr(size_t i) {
+    return table(6 + i);
+}
+
+static uint32_t table_size(size_t i) {
+    uint32_t w = table(table(2) / 4 + i / 2);
+    return (i & 1) ? (w >> 16) : (w & 0xFFFFu);
+}
+
+static std::string lookup(uint32_t addr, size_t sz = 256) {
+    char name[256];
+    uint32_t offset = 0xDEADu;
+    memset(name, 'X', sizeof(name));
+    if (!backtraceLog_symbol((const void *)(uintptr_t)addr, name, sz, &offset)) {
+        return "??";
+    }
+    CHECK(strlen(name) < sz);
+    for (size_t i = sz; i < sizeof(name); i++) {
+        if ('X' != name[i]) { CHECK(!"wrote past sz"); break; }
+    }
+    char buf[300];
+    snprintf(buf, sizeof(buf), "%s+0x%x", name, offset);
+    return buf;
+}
+
+// The script's reader, "<addr> <name>+<offset>" per address
+static std::vector<std::string> script_lookup(const std::vector<uint32_t> &addrs) {
+    std::vector<std::string> out;
+    char self[512];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len <= 0) return out;
+    self[len] = 0;
+    std::string cmd = std::string("ESP_TOOLCHAIN_NM=nm ESP_TOOLCHAIN_OBJDUMP=objdump bash ") +
+        EMBED_SYMBOLS + " -l " + self;
+    char a[16];
+    for (uint32_t addr : addrs) {
+        snprintf(a, sizeof(a), " 0x%08x", addr);
+        cmd += a;
+    }
+    FILE *f = popen(cmd.c_str(), "r");
+    if (NULL == f) return out;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        std::string s(line);
+        while (!s.empty() && '\n' == s.back()) s.pop_back();
+        size_t sp = s.find(' ');
+        out.push_back((std::string::npos == sp) ? s : s.substr(sp + 1));
+    }
+    pclose(f);
+    return out;
+}
+
+static void test_known_names(void) {
+    CHECK("symtest_fn_00+0x0" == lookup((uint32_t)(uintptr_t)&symtest_fn_00));
+    CHECK("symtest_fn_17+0x3" == lookup((uint32_t)(uintptr_t)&symtest_fn_17 + 3));
+    CHECK("symtest_fn_34+0x1" == lookup((uint32_t)(uintptr_t)&symtest_fn_34 + 1));
+
+    // Parameter lists are dropped, overloads share a name
+    int (symtest::Widget::*m1)(int) = &symtest::Widget::overloaded;
+    int (symtest::Widget::*m2)(const char *) = &symtest::Widget::overloaded;
+    uint32_t a1, a2;
+    memcpy(&a1, &m1, sizeof(a1));
+    memcpy(&a2, &m2, sizeof(a2));
+    CHECK("symtest::Widget::overloaded()+0x0" == lookup(a1));
+    CHECK("symtest::Widget::overloaded()+0x0" == lookup(a2));
+    CHECK(a1 != a2);
+}
+
+static void test_truncation(void) {
+    const uint32_t pc = (uint32_t)(uintptr_t)&symtest_a_very_long_function_name_to_check_that_the_lookup_truncates_names_to_the_buffer_size_it_is_given_ok + 2;
+    CHECK(std::string(long_name) + "+0x2" == lookup(pc));
+    CHECK(std::string(long_name, 63) + "+0x2" == lookup(pc, 64));
+    CHECK(std::string(long_name, 4) + "+0x2" == lookup(pc, 5));
+    CHECK("+0x2" == lookup(pc, 1));      // Just the terminator
+    CHECK("??" == lookup(pc, 0));
+
+    // Truncating one name must not change the next, decoded from it
+    uint32_t a = (uint32_t)(uintptr_t)&symtest_fn_01;
+    char name[8];
+    uint32_t offset;
+    CHECK(backtraceLog_symbol((const void *)(uintptr_t)a, name, sizeof(name), &offset));
+    CHECK(0 == strcmp(name, "symtest"));
+    CHECK("symtest_fn_01+0x0" == lookup(a));
+    CHECK(backtraceLog_symbol((const void *)(uintptr_t)a, name, sizeof(name), NULL));
+}
+
+static void test_outside(void) {
+    CHECK("??" == lookup(0x40000000u));
+    CHECK("??" == lookup(0x3FFE8000u));
+    size_t n = table_count();
+    CHECK("??" == lookup(table_addr(n - 1) + table_size(n - 1)));
+    CHECK("??" == lookup(0xFFFFFFF0u));
+}
+
+// Every function, first and last byte, agrees with the script's reader
+static void test_all_against_script(void) {
+    size_t n = table_count();
+    CHECK(n > 2 * 16 + 2);
+    std::vector<uint32_t> addrs;
+    for (size_t i = 0; i < n; i++) {
+        addrs.push_back(table_addr(i));
+        addrs.push_back(table_addr(i) + table_size(i) - 1u);
+        CHECK(i == 0 || table_addr(i - 1) < table_addr(i));
+    }
+    std::vector<std::string> expect = script_lookup(addrs);
+    CHECK_EQ(expect.size(), addrs.size());
+    size_t bad = 0, restarts = 0;
+    for (size_t i = 0; i < addrs.size() && i < expect.size(); i++) {
+        std::string got = lookup(addrs[i]);
+        if (got != expect[i]) {
+            if (bad++ < 8) {
+                fprintf(stderr, "0x%08x: %s, script: %s\n", addrs[i], got.c_str(), expect[i].c_str());
+            }
+        }
+        if ("??" == got) bad++;
+        // Last entry before a restart, the restart, and the one after it
+        size_t e = i / 2;
+        if (e > 0 && (15 == e % 16 || 0 == e % 16 || 1 == e % 16)) restarts++;
+    }
+    CHECK_EQ(bad, 0);
+    CHECK(restarts >= 2 * 3 * 2);
+}
+
+static void test_unfilled(void) {
+    // Open up the table, it is in flash on the target
+    uintptr_t page = (uintptr_t)backtraceLog_symbols & ~(uintptr_t)4095u;
+    uintptr_t end = (uintptr_t)backtraceLog_symbols + sizeof(backtraceLog_symbols);
+    CHECK(0 == mprotect((void *)page, end - page, PROT_READ | PROT_WRITE));
+    // volatile, the compiler may take the const table as never changing
+    volatile uint32_t *t = (volatile uint32_t *)(uintptr_t)backtraceLog_symbols;
+    const uint32_t pc = (uint32_t)(uintptr_t)&symtest_fn_17;
+
+    uint32_t saved = t[0];
+    t[0] = 0;           // magic, as built
+    CHECK("??" == lookup(pc));
+    t[0] = saved;
+
+    saved = t[5];
+    t[5] = sizeof(backtraceLog_symbols) + 4u;   // used, past the end
+    CHECK("??" == lookup(pc));
+    t[5] = saved;
+    CHECK("symtest_fn_17+0x0" == lookup(pc));
+    mprotect((void *)page, end - page, PROT_READ);
+}
+
+int main() {
+    host_core_begin();
+    if (0x59535442u != table(0)) {
+        fprintf(stderr, "%s: symbol table not filled in, run scripts/embed_symbols.sh\n", TEST_NAME);
+        return 1;
+    }
+    test_known_names();
+    test_truncation();
+    test_outside();
+    test_all_against_script();
+    test_unfilled();
+    return host_result(TEST_NAME);
+}
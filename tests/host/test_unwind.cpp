@@ -0,0 +1,326 @@
+/*
+ *   Copyright 2022 M Hightower
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+/*
+  Host test of the unwinder, xt_retaddr_callee_ex() in backtrace.cpp.
+
+  backtrace.cpp is built for the host as is, except its code byte and stack
+  word reads come here, see _get_uint8() and _get_stack_uint32(). They read a
+  sparse memory image, unset bytes read as zero. Every read is checked:
+    code   in ROM, IRAM or the mapped flash, no further back from i_pc than
+           BACKTRACE_MAX_SCAN and at most a forward search past it.
+    stack  aligned and in DRAM.
+  A run of reads too long to be a bounded scan fails the test.
+
+  The regression corpus is the .txt files in unwind/, one case or more each:
+    code ADDR BYTE...         code bytes at ADDR
+    word ADDR VALUE           a stack word
+    unwind PC SP LR           call xt_retaddr_callee_ex()
+    expect 0                  it fails
+    expect 1 PC SP FN         it succeeds with these outputs
+    reads N                   the last unwind read N code bytes
+  Numbers are hex. '#' starts a comment. The image is kept across the cases
+  of a file.
+
+  The random cases follow. Generated frames, with their prologue and the
+  return address saved where the generator put it, must unwind to that
+  answer. Random code and stack bytes need only stay within the checks above.
+*/
+#include "host_core.h"
+#include <backtrace.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+// backtrace.cpp's default
+#ifndef BACKTRACE_MAX_SCAN
+#define BACKTRACE_MAX_SCAN (64 * 1024)
+#endif
+
+// The forward searches from a candidate reach 32 bytes and an instruction past it.
+static constexpr uint32_t max_forward = 40u;
+static constexpr size_t max_reads = 16u * 1024u * 1024u;
+
+static std::unordered_map<uint32_t, uint8_t> code;
+static std::unordered_map<uint32_t, uint32_t> stack;
+static uint32_t scan_pc;
+static size_t code_reads, stack_reads, bad_reads;
+
+static bool is_code_addr(uintptr_t a) {
+    return (a >= 0x40000000u && a < 0x40010000u) ||   // Boot ROM
+           (a >= host_iram_start && a < host_iram_end) ||
+           (a >= 0x40200000u && a < 0x40300000u);     // 1MB of flash mapped
+}
+
+static void bad_read(const char *what, uintptr_t a) {
+    if (bad_reads++ < 8) {
+        fprintf(stderr, "%s read at 0x%08llx, unwinding from 0x%08x\n",
+            what, (unsigned long long)a, scan_pc);
+    }
+}
+
+static void count_read(size_t *reads) {
+    if (++*reads > max_reads) {
+        fprintf(stderr, "unbounded scan, unwinding from 0x%08x\n", scan_pc);
+        exit(1);
+    }
+}
+
+extern "C" uint8_t backtrace_host_code_uint8(const void *p8) {
+    uintptr_t a = (uintptr_t)p8;
+    count_read(&code_reads);
+    if (!is_code_addr(a) || a + BACKTRACE_MAX_SCAN < scan_pc || a >= scan_pc + max_forward) {
+        bad_read("code", a);
+        return 0;
+    }
+    auto it = code.find((uint32_t)a);
+    return (code.end() == it) ? 0 : it->second;
+}
+
+extern "C" uint32_t backtrace_host_stack_uint32(const uint32_t *p32) {
+    uintptr_t a = (uintptr_t)p32;
+    count_read(&stack_reads);
+    if (0 != (a & 3u) || a < host_dram_start || a >= host_dram_end) {
+        bad_read("stack", a);
+        return 0;
+    }
+    auto it = stack.find((uint32_t)a);
+    return (stack.end() == it) ? 0 : it->second;
+}
+
+struct Unwind {
+    int ret;
+    uint32_t pc, sp, fn;
+};
+
+static Unwind unwind(uint32_t pc, uint32_t sp, uint32_t lr) {
+    const void *o_pc = (const void *)(uintptr_t)0xDEAD0000u;
+    const void *o_sp = (const void *)(uintptr_t)0xDEAD0004u;
+    const void *o_fn = (const void *)(uintptr_t)0xDEAD0008u;
+    scan_pc = pc;
+    code_reads = stack_reads = bad_reads = 0;
+    Unwind u;
+    u.ret = xt_retaddr_callee_ex((const void *)(uintptr_t)pc, (const void *)(uintptr_t)sp,
+        (const void *)(uintptr_t)lr, &o_pc, &o_sp, &o_fn);
+    u.pc = (uint32_t)(uintptr_t)o_pc;
+    u.sp = (uint32_t)(uintptr_t)o_sp;
+    u.fn = (uint32_t)(uintptr_t)o_fn;
+    return u;
+}
+
+static uint32_t hex(std::istringstream &in) {
+    std::string s;
+    in >> s;
+    return (uint32_t)strtoul(s.c_str(), NULL, 16);
+}
+
+static void run_corpus_file(const std::string &path) {
+    std::ifstream f(path);
+    CHECK(f.good());
+    code.clear();
+    stack.clear();
+    std::string line;
+    Unwind u = {0, 0, 0, 0};
+    int n = 0, failures = host_failures;
+    while (std::getline(f, line)) {
+        n++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string op;
+        if (!(in >> op)) continue;
+        if ("code" == op) {
+            uint32_t a = hex(in);
+            std::string b;
+            while (in >> b) code[a++] = (uint8_t)strtoul(b.c_str(), NULL, 16);
+        } else if ("word" == op) {
+            uint32_t a = hex(in);
+            stack[a] = hex(in);
+        } else if ("unwind" == op) {
+            uint32_t pc = hex(in);
+            uint32_t sp = hex(in);
+            uint32_t lr = hex(in);
+            u = unwind(pc, sp, lr);
+            CHECK_EQ(bad_reads, 0);
+        } else if ("expect" == op) {
+            int ret = (int)hex(in);
+            CHECK_EQ(u.ret, ret);
+            if (ret) {
+                CHECK_EQ(u.pc, hex(in));
+                CHECK_EQ(u.sp, hex(in));
+                CHECK_EQ(u.fn, hex(in));
+            }
+        } else if ("reads" == op) {
+            CHECK_EQ(code_reads, hex(in));
+        } else {
+            fprintf(stderr, "%s:%d: unknown \"%s\"\n", path.c_str(), n, op.c_str());
+            host_failures++;
+        }
+        if (failures != host_failures) {
+            fprintf(stderr, "  at %s:%d\n", path.c_str(), n);
+            failures = host_failures;
+        }
+    }
+}
+
+static void test_corpus(void) {
+    std::vector<std::string> files;
+    DIR *d = opendir(UNWIND_CORPUS);
+    CHECK(NULL != d);
+    if (NULL == d) return;
+    while (struct dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() > 4 && ".txt" == name.substr(name.size() - 4)) {
+            files.push_back(std::string(UNWIND_CORPUS) + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    CHECK(files.size() >= 5);
+    for (const std::string &path : files) {
+        run_corpus_file(path);
+    }
+}
+
+static uint32_t rng_state = 0x2545F491u;
+
+static uint32_t rnd(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+static uint32_t rnd(uint32_t lo, uint32_t hi) {
+    return lo + rnd() % (hi - lo);
+}
+
+static uint32_t random_flash_pc(void) {
+    return rnd(0x40201000u, 0x402F0000u);
+}
+
+// A call0 function: addi a1, a1, -size; s32i.n a0, a1, a0_off; then filler
+// that matches none of the patterns scanned for, ending at pc.
+static void test_generated_frames(void) {
+    size_t bad = 0;
+    for (int i = 0; i < 4000; i++) {
+        code.clear();
+        stack.clear();
+        uint32_t fn = random_flash_pc() & ~3u;
+        uint32_t size = 16u * rnd(1, 9);
+        uint32_t a0_off = 4u * rnd(0, (size / 4u < 16u) ? size / 4u : 16u);
+        uint32_t p = fn;
+        for (uint32_t a = fn - 16u; a < fn; a++) code[a] = (uint8_t)rnd();
+        code[p++] = 0x12;
+        code[p++] = 0xc1;
+        code[p++] = (uint8_t)(256u - size);
+        code[p++] = 0x09;
+        code[p++] = (uint8_t)((a0_off / 4u) << 4 | 1u);
+        for (uint32_t n = rnd(0, 40); n; n--) {
+            switch (rnd() % 3) {
+            case 0:     // nop.n
+                code[p++] = 0x3d; code[p++] = 0xf0;
+                break;
+            case 1:     // nop
+                code[p++] = 0xf0; code[p++] = 0x20; code[p++] = 0x00;
+                break;
+            default:    // call0
+                code[p++] = 0x05; code[p++] = (uint8_t)(0x40u | rnd(0, 16)); code[p++] = 0x00;
+                break;
+            }
+        }
+        uint32_t pc = p;
+        uint32_t sp = rnd(host_dram_start, host_dram_end - 0x1000u) & ~15u;
+        uint32_t ret = random_flash_pc();
+        stack[sp + a0_off] = ret;
+        uint32_t lr = (rnd() & 1u) ? random_flash_pc() : 0u;
+        Unwind u = unwind(pc, sp, lr);
+        if (bad_reads || 1 != u.ret || ret != u.pc || sp + size != u.sp || fn != u.fn) {
+            if (bad++ < 4) {
+                fprintf(stderr, "frame fn 0x%08x size %u a0 +%u pc 0x%08x: %d 0x%08x 0x%08x 0x%08x\n",
+                    fn, size, a0_off, pc, u.ret, u.pc, u.sp, u.fn);
+            }
+        }
+    }
+    CHECK_EQ(bad, 0);
+}
+
+// Random code, stack and starting values. Any answer will do, as long as
+// the reads stay in bounds and a success is plausible.
+static void test_random_images(void) {
+    static const uint8_t frags[][3] = {
+        {0x12, 0xc1, 0xf0}, {0x12, 0xc1, 0x80}, {0x92, 0xa1, 0x00}, {0x92, 0xaf, 0x00},
+        {0x90, 0x11, 0xc0}, {0x9a, 0x11, 0x00}, {0x02, 0x61, 0x3f}, {0x09, 0x31, 0x00},
+        {0x22, 0xd1, 0x7f}, {0x0d, 0xf0, 0x00}, {0x80, 0x00, 0x00}, {0x3d, 0xf0, 0x00},
+    };
+    size_t bad = 0, found = 0;
+    for (int i = 0; i < 4000; i++) {
+        code.clear();
+        stack.clear();
+        uint32_t pc;
+        switch (rnd() % 4) {
+        case 0:  pc = rnd(0x40000000u, 0x4000e328u); break;
+        case 1:  pc = rnd(host_iram_start, 0x40107000u); break;
+        case 2:  pc = rnd(0x40200000u, 0x40201000u); break;
+        default: pc = random_flash_pc(); break;
+        }
+        uint32_t span = rnd(16, 1024);
+        for (uint32_t a = pc - span; a < pc + max_forward; a++) {
+            if (0 == rnd() % 8) {
+                const uint8_t *f = frags[rnd() % (sizeof(frags) / sizeof(frags[0]))];
+                for (int k = 0; k < 3; k++) code[a + k] = f[k];
+                a += 2;
+            } else {
+                code[a] = (uint8_t)rnd();
+            }
+        }
+        uint32_t sp;
+        switch (rnd() % 8) {
+        case 0:  sp = rnd(0x3FFE0000u, 0x40010000u); break;              // anything near
+        case 1:  sp = rnd(host_dram_end - 64u, host_dram_end) & ~3u; break; // top of DRAM
+        default: sp = rnd(host_dram_start, host_dram_end) & ~15u; break;
+        }
+        for (uint32_t a = sp & ~3u; a < sp + 2048u && a < host_dram_end; a += 4u) {
+            if (0 == rnd() % 4) stack[a] = (rnd() & 1u) ? random_flash_pc() : rnd();
+        }
+        uint32_t lr = (rnd() & 1u) ? random_flash_pc() : rnd();
+        Unwind u = unwind(pc, sp, lr);
+        bool ok = 0 == bad_reads;
+        if (1 == u.ret) {
+            found++;
+            ok = ok && xt_pc_is_valid((const void *)(uintptr_t)u.pc);
+            // Unwinding only ever moves up the stack
+            ok = ok && u.sp >= sp && 0 == ((u.sp - sp) & 3u);
+            ok = ok && (0 == u.fn || (0 == (u.fn & 3u) && u.fn < pc));
+        } else {
+            ok = ok && 0 == u.ret;
+        }
+        if (!ok && bad++ < 4) {
+            fprintf(stderr, "random pc 0x%08x sp 0x%08x lr 0x%08x: %d 0x%08x 0x%08x 0x%08x\n",
+                pc, sp, lr, u.ret, u.pc, u.sp, u.fn);
+        }
+    }
+    CHECK_EQ(bad, 0);
+    CHECK(found > 0);
+}
+
+int main() {
+    test_corpus();
+    test_generated_frames();
+    test_random_images();
+    return host_result(TEST_NAME);
+}